@@ -137,7 +137,9 @@ void CDC_Device_USBTask(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
 	  return;
 
-	#if !defined(NO_CLASS_DRIVER_AUTOFLUSH)
+	#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+	CDC_Device_TxQueueDrain(CDCInterfaceInfo);
+	#elif !defined(NO_CLASS_DRIVER_AUTOFLUSH)
 	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
 
 	if (Endpoint_IsINReady())
@@ -151,8 +153,15 @@ uint8_t CDC_Device_SendString(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
 	  return ENDPOINT_RWSTREAM_DeviceDisconnected;
 
+	#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+	for (const char* c = String; *c; c++)
+	  CDC_Device_TxQueueWrite(CDCInterfaceInfo, *c);
+
+	return ENDPOINT_RWSTREAM_NoError;
+	#else
 	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
 	return Endpoint_Write_Stream_LE(String, strlen(String), NULL);
+	#endif
 }
 
 uint8_t CDC_Device_SendString_P(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
@@ -161,8 +170,17 @@ uint8_t CDC_Device_SendString_P(USB_ClassInfo_CDC_Device_t* const CDCInterfaceIn
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
 	  return ENDPOINT_RWSTREAM_DeviceDisconnected;
 
+	#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+	char c;
+
+	for (const char* p = String; (c = pgm_read_byte(p)) != 0; p++)
+	  CDC_Device_TxQueueWrite(CDCInterfaceInfo, c);
+
+	return ENDPOINT_RWSTREAM_NoError;
+	#else
 	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
 	return Endpoint_Write_PStream_LE(String, strlen_P(String), NULL);
+	#endif
 }
 
 uint8_t CDC_Device_SendData(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
@@ -172,8 +190,17 @@ uint8_t CDC_Device_SendData(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
 	  return ENDPOINT_RWSTREAM_DeviceDisconnected;
 
+	#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+	const uint8_t* Data = (const uint8_t*)Buffer;
+
+	for (uint16_t i = 0; i < Length; i++)
+	  CDC_Device_TxQueueWrite(CDCInterfaceInfo, Data[i]);
+
+	return ENDPOINT_RWSTREAM_NoError;
+	#else
 	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
 	return Endpoint_Write_Stream_LE(Buffer, Length, NULL);
+	#endif
 }
 
 uint8_t CDC_Device_SendData_P(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
@@ -183,8 +210,17 @@ uint8_t CDC_Device_SendData_P(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
 	  return ENDPOINT_RWSTREAM_DeviceDisconnected;
 
+	#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+	const uint8_t* Data = (const uint8_t*)Buffer;
+
+	for (uint16_t i = 0; i < Length; i++)
+	  CDC_Device_TxQueueWrite(CDCInterfaceInfo, pgm_read_byte(&Data[i]));
+
+	return ENDPOINT_RWSTREAM_NoError;
+	#else
 	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
 	return Endpoint_Write_PStream_LE(Buffer, Length, NULL);
+	#endif
 }
 
 uint8_t CDC_Device_SendByte(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
@@ -193,6 +229,9 @@ uint8_t CDC_Device_SendByte(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
 	  return ENDPOINT_RWSTREAM_DeviceDisconnected;
 
+	#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+	CDC_Device_TxQueueWrite(CDCInterfaceInfo, Data);
+	#else
 	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
 
 	if (!(Endpoint_IsReadWriteAllowed()))
@@ -206,6 +245,8 @@ uint8_t CDC_Device_SendByte(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
 	}
 
 	Endpoint_Write_8(Data);
+	#endif
+
 	return ENDPOINT_READYWAIT_NoError;
 }
 
@@ -214,6 +255,10 @@ uint8_t CDC_Device_Flush(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
 	  return ENDPOINT_RWSTREAM_DeviceDisconnected;
 
+	#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+	CDCInterfaceInfo->State.TxFlushPending = true;
+	CDC_Device_TxQueueDrain(CDCInterfaceInfo);
+	#else
 	uint8_t ErrorCode;
 
 	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
@@ -232,10 +277,112 @@ uint8_t CDC_Device_Flush(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
 
 		Endpoint_ClearIN();
 	}
+	#endif
 
 	return ENDPOINT_READYWAIT_NoError;
 }
 
+#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+uint8_t CDC_Device_TxQueueFree(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
+{
+	return (CDC_DEVICE_TX_QUEUE_SIZE - CDCInterfaceInfo->State.TxQueueCount);
+}
+
+static void CDC_Device_TxQueueWrite(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+                                    const uint8_t Data)
+{
+	uint8_t  Count;
+	uint16_t Tail;
+
+	/* Opportunistically move queued bytes into a free endpoint bank before giving up on a full queue */
+	if (CDCInterfaceInfo->State.TxQueueCount == CDC_DEVICE_TX_QUEUE_SIZE)
+	  CDC_Device_TxQueueDrain(CDCInterfaceInfo);
+
+	Count = CDCInterfaceInfo->State.TxQueueCount;
+
+	if (Count == CDC_DEVICE_TX_QUEUE_SIZE)
+	{
+		if (CDCInterfaceInfo->State.TxDropped != 0xFFFF)
+		  CDCInterfaceInfo->State.TxDropped++;
+
+		#if defined(CDC_DEVICE_TX_QUEUE_DROP_OLDEST)
+		if (++CDCInterfaceInfo->State.TxQueueHead == CDC_DEVICE_TX_QUEUE_SIZE)
+		  CDCInterfaceInfo->State.TxQueueHead = 0;
+
+		Count--;
+		#else
+		return;
+		#endif
+	}
+
+	Tail = CDCInterfaceInfo->State.TxQueueHead + Count;
+	if (Tail >= CDC_DEVICE_TX_QUEUE_SIZE)
+	  Tail -= CDC_DEVICE_TX_QUEUE_SIZE;
+
+	CDCInterfaceInfo->State.TxQueue[Tail] = Data;
+	CDCInterfaceInfo->State.TxQueueCount  = Count + 1;
+}
+
+static void CDC_Device_TxQueueDrain(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
+{
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
+	  return;
+
+	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address);
+
+	while (CDCInterfaceInfo->State.TxQueueCount)
+	{
+		if (!(Endpoint_IsINReady()))
+		  return;
+
+		if (!(Endpoint_IsReadWriteAllowed()))
+		{
+			Endpoint_ClearIN();
+			CDCInterfaceInfo->State.TxLastPacketFull = true;
+			continue;
+		}
+
+		Endpoint_Write_8(CDCInterfaceInfo->State.TxQueue[CDCInterfaceInfo->State.TxQueueHead]);
+
+		if (++CDCInterfaceInfo->State.TxQueueHead == CDC_DEVICE_TX_QUEUE_SIZE)
+		  CDCInterfaceInfo->State.TxQueueHead = 0;
+
+		CDCInterfaceInfo->State.TxQueueCount--;
+	}
+
+	/* Full banks are always sent, partial banks only once flushed (or always without NO_CLASS_DRIVER_AUTOFLUSH) */
+	if (Endpoint_BytesInEndpoint())
+	{
+		if (!(Endpoint_IsINReady()))
+		  return;
+
+		bool BankFull = !(Endpoint_IsReadWriteAllowed());
+
+		#if defined(NO_CLASS_DRIVER_AUTOFLUSH)
+		if (!(BankFull) && !(CDCInterfaceInfo->State.TxFlushPending))
+		  return;
+		#endif
+
+		Endpoint_ClearIN();
+		CDCInterfaceInfo->State.TxLastPacketFull = BankFull;
+	}
+
+	/* As in the unqueued CDC_Device_Flush(), a flush ending on a full packet is followed by a zero length
+	 * packet, otherwise the host may hold the data back until more arrives. Retried on the next drain
+	 * while the bank is still busy. */
+	if (CDCInterfaceInfo->State.TxFlushPending && CDCInterfaceInfo->State.TxLastPacketFull)
+	{
+		if (!(Endpoint_IsINReady()))
+		  return;
+
+		Endpoint_ClearIN();
+		CDCInterfaceInfo->State.TxLastPacketFull = false;
+	}
+
+	CDCInterfaceInfo->State.TxFlushPending = false;
+}
+#endif
+
 uint16_t CDC_Device_BytesReceived(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
 {
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
@@ -87,6 +87,10 @@
 			#error Do not include this file directly. Include LUFA/Drivers/USB.h instead.
 		#endif
 
+		#if defined(CDC_DEVICE_TX_QUEUE_SIZE) && ((CDC_DEVICE_TX_QUEUE_SIZE < 1) || (CDC_DEVICE_TX_QUEUE_SIZE > 255))
+			#error CDC_DEVICE_TX_QUEUE_SIZE must be between 1 and 255.
+		#endif
+
 	/* Public Interface - May be used in end-application: */
 		/* Type Defines: */
 			/** \brief CDC Class Device Mode Configuration and State Structure.
@@ -124,6 +128,15 @@
 					                                  *   This is generally only used if the virtual serial port data is to be
 					                                  *   reconstructed on a physical UART.
 					                                  */
+
+					#if defined(CDC_DEVICE_TX_QUEUE_SIZE) || defined(__DOXYGEN__)
+					uint8_t  TxQueue[CDC_DEVICE_TX_QUEUE_SIZE]; /**< Bytes waiting to be written to the data IN endpoint. */
+					uint8_t  TxQueueHead; /**< Index of the oldest byte in the transmit queue. */
+					uint8_t  TxQueueCount; /**< Number of bytes in the transmit queue. */
+					bool     TxFlushPending; /**< Set by \ref CDC_Device_Flush() to send a partial packet once the queue drains. */
+					bool     TxLastPacketFull; /**< Set when the last packet sent filled the bank, so a flush must end the transfer with a zero length packet. */
+					uint16_t TxDropped; /**< Number of bytes discarded because the transmit queue was full, saturating at 0xFFFF. */
+					#endif
 				} State; /**< State data for the USB class interface within the device. All elements in this section
 				          *   are reset to their defaults when the interface is enumerated.
 				          */
@@ -305,6 +318,19 @@
 			 */
 			uint8_t CDC_Device_Flush(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo) ATTR_NON_NULL_PTR_ARG(1);
 
+			#if defined(CDC_DEVICE_TX_QUEUE_SIZE) || defined(__DOXYGEN__)
+			/** Determines how many more bytes can be queued for transmission without any being dropped. This allows an application
+			 *  to skip a whole frame of data rather than have it truncated when the host is not reading fast enough.
+			 *
+			 *  \note This function is only available when the \c CDC_DEVICE_TX_QUEUE_SIZE compile time token is defined.
+			 *
+			 *  \param[in,out] CDCInterfaceInfo  Pointer to a structure containing a CDC Class configuration and state.
+			 *
+			 *  \return Number of free bytes in the transmit queue.
+			 */
+			uint8_t CDC_Device_TxQueueFree(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo) ATTR_NON_NULL_PTR_ARG(1);
+			#endif
+
 			/** Sends a Serial Control Line State Change notification to the host. This should be called when the virtual serial
 			 *  control lines (DCD, DSR, etc.) have changed states, or to give BREAK notifications to the host. Line states persist
 			 *  until they are cleared via a second notification. This should be called each time the CDC class driver's
@@ -362,6 +388,12 @@
 				static int CDC_Device_getchar_Blocking(FILE* Stream) ATTR_NON_NULL_PTR_ARG(1);
 				#endif
 
+				#if defined(CDC_DEVICE_TX_QUEUE_SIZE)
+				static void CDC_Device_TxQueueWrite(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+				                                    const uint8_t Data) ATTR_NON_NULL_PTR_ARG(1);
+				static void CDC_Device_TxQueueDrain(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo) ATTR_NON_NULL_PTR_ARG(1);
+				#endif
+
 				void CDC_Device_Event_Stub(void) ATTR_CONST;
 
 				void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
@@ -54,7 +54,9 @@
 //		#define HID_MAX_COLLECTIONS              {Insert Value Here}
 //		#define HID_MAX_REPORTITEMS              {Insert Value Here}
 //		#define HID_MAX_REPORT_IDS               {Insert Value Here}
-//		#define NO_CLASS_DRIVER_AUTOFLUSH
+		#define NO_CLASS_DRIVER_AUTOFLUSH
+		#define CDC_DEVICE_TX_QUEUE_SIZE         128
+//		#define CDC_DEVICE_TX_QUEUE_DROP_OLDEST
 
 		/* General USB Driver Related Tokens: */
 //		#define ORDERED_EP_CONFIG
@@ -7,7 +7,48 @@
 ISR(TIMER1_COMPA_vect){
 	timer++;
 
-	if ((timer) % (READ_RF_DELAY * PRINTING_RATE) == 0){ schedule_read_rf = 1; }
+	if (REPORT_MODE == REPORT_TIME && --report_countdown == 0) {
+		report_countdown = REPORT_INTERVAL;
+		schedule_read_rf = 1;
+	}
+}
+
+// Timer 0 compare match, which starts timed conversions. The ADC triggers on the rising
+// edge of OCF0A, entering this vector clears it straight away for the next match.
+EMPTY_INTERRUPT(TIMER0_COMPA_vect);
+
+// ADC conversion complete interrupt, runs once per timed, free-running or sleep conversion
+ISR(ADC_vect){
+	uint16_t sample = ADCW;
+	
+	// Tell ADC_Sleep_Convert() the conversion, not some other interrupt, woke it
+	ADC_CONVERTED = 1;
+
+	// Drop conversions that were started before the input settled
+	if (ADC_DISCARD) {
+		ADC_DISCARD--;
+		return;
+	}
+
+	// Raw conversions go straight to the capture buffer while one is armed or recording
+	if (CAPTURE_STATE >= CAPTURE_ARMED) {
+		CAPTURE_Sample(sample);
+		return;
+	}
+
+	// Without oversampling skip the 32 bit sum, this runs for every conversion
+	if (ADC_OVERSAMPLE == 0) {
+		SAMPLES_Insert(sample);
+		return;
+	}
+
+	// Oversample and decimate, 4^n conversions make one sample with n extra bits
+	ADC_OS_SUM += sample;
+	if (--ADC_OS_COUNT) { return; }
+	
+	SAMPLES_Insert(ADC_OS_SUM >> ADC_OVERSAMPLE);
+	ADC_OS_SUM = 0;
+	ADC_OS_COUNT = 1 << (2 * ADC_OVERSAMPLE);
 }
 
 // Main program entry point.
@@ -21,11 +62,11 @@ int main(void) {
 	int16_t BYTE_IN = -1;
 	DATA_IN = malloc(DATA_BUFF_LEN);
 
-	// Set up timer 1 for 0.25s interrupts
+	// Set up timer 1 for 1ms interrupts
 	TCCR1A = 0b00000000; // No pin changes on compare match
 	TCCR1B = 0b00001010; // Clear timer on compare match, clock /8
 	TCCR1C = 0b00000000; // No forced output compare
-	OCR1A = 31250; // Set timer clear at this count value
+	OCR1A = (F_CPU / 8 / TICKS_PER_SECOND) - 1; // Set timer clear at this count value
 	TCNT1 = 0;
 	TIMSK1 = 0b00000010; // Enable interrupts on the A compare match
 
@@ -37,9 +78,10 @@ int main(void) {
 	clock_prescale_set(clock_div_16);
 
 	// Init USB hardware and create a regular character stream for the
-	// USB interface so that it can be used with the stdio.h functions
+	// USB interface so that it can be used with the stdio.h functions.
+	// Text goes through USB_Putchar(), which waits for room rather than drop bytes.
 	USB_Init();
-	CDC_Device_CreateStream(&VirtualSerial_CDC_Interface, &USBSerialStream);
+	fdev_setup_stream(&USBSerialStream, USB_Putchar, NULL, _FDEV_SETUP_WRITE);
 	run_lufa();
 
 	// Enable interrupts
@@ -50,18 +92,24 @@ int main(void) {
 
 	// Print startup message
 	printPGMStr(PSTR(SOFTWARE_STR));
-	fprintf(&USBSerialStream, " V%s,%s", HARDWARE_VERS, SOFTWARE_VERS);
+	fprintf_P(&USBSerialStream, PSTR(" V%s,%s"), HARDWARE_VERS, SOFTWARE_VERS);
 	run_lufa();
 
 	// Configure LED Pin
 	DDRF |= (1 << LED);
 	Set_LED(0);
 
-	// Enable the ADC
-	ADCSRA = (1<<ADEN) | (1<<ADPS2) | (1<<ADPS1) | (1<<ADPS0); // Enable ADC, clocked by /128 divider
+	// Enable the ADC and start acquisition, paced by timer 0
+	ADC_Start_RF();
 	
-	// Check that the EEPROM has been initialized
-	if (eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_EEPROM_INIT)) != EEPROM_VERS) {
+	// Check that the EEPROM has been initialized, bringing a version 1 layout forward
+	if (eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_EEPROM_INIT)) == 1) {
+		printPGMStr(PSTR("\r\nEEPROM V1. Migrating..."));
+		run_lufa();
+		EEPROM_Migrate_V1();
+		eeprom_update_byte((uint8_t*)(EEPROM_OFFSET_EEPROM_INIT), EEPROM_VERS);
+	}
+	if (eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_EEPROM_INIT)) != EEPROM_VERS || !EEPROM_Cal_Load()) {
 		printPGMStr(PSTR("\r\nEEPROM not initialized. Initializing..."));
 		run_lufa();
 		EEPROM_Init();
@@ -69,6 +117,7 @@ int main(void) {
 	}
 	
 	// Load calibration values
+	TEMP_Load();
 	Load_RF_Calibration(1);
 	
 	run_lufa();
@@ -80,14 +129,28 @@ int main(void) {
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 	for (;;) {
-		// Read a byte from the USB serial stream
-		BYTE_IN = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
+		if (BLOCK_Busy()) {
+			// Send more of the binary block in progress. Input waits until it's done so
+			// echoed chars can't land in the middle of it.
+			BLOCK_Continue();
+			BYTE_IN = -1;
+		} else if (BLOCK_Receiving()) {
+			// Binary upload in progress, its bytes bypass the line editor
+			BLOCK_Receive();
+			BYTE_IN = -1;
+		} else {
+			// Read a byte from the USB serial stream
+			BYTE_IN = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
+		}
 
 		// USB Serial stream will return <0 if no bytes are available.
 		if (BYTE_IN >= 0) {
 			// Echo the char we just received back out the serial stream so the user's 
-			// console will display it.
-			fputc(BYTE_IN, &USBSerialStream);
+			// console will display it. Scripted hosts don't want it back.
+			if (!MACHINE_MODE) {
+				fputc(BYTE_IN, &USBSerialStream);
+				USB_Flush();
+			}
 
 			// Switch on the input byte to determine what is is and what to do.
 			switch (BYTE_IN) {
@@ -97,19 +160,31 @@ int main(void) {
 					if (DATA_IN_POS > 0){
 						DATA_IN_POS--;
 						DATA_IN[DATA_IN_POS] = 0;
-						printPGMStr(STR_Backspace);
+						if (!MACHINE_MODE) { printPGMStr(STR_Backspace); }
 					}
 					break;
 
 				case '\n':
 				case '\r':
-					// Newline, Parse our command
-					INPUT_Parse();
+					// Newline, Parse our command. In machine mode the LF of a CR LF, or any
+					// other empty line, is ignored rather than answered with an error. The end
+					// of an overlong line was already answered with ERR_LENGTH.
+					if (INPUT_DISCARD) {
+						INPUT_DISCARD = 0;
+					} else if (DATA_IN_POS > 0 || !MACHINE_MODE) {
+						INPUT_Parse();
+					}
 					INPUT_Clear();
 					break;
 
 				case 3:
-					// Ctrl-c bail out on partial command
+					// Ctrl-c bail out on partial command, a capture waiting for its trigger, or a query
+					if (CAPTURE_STATE != CAPTURE_IDLE) {
+						CAPTURE_STATE = CAPTURE_IDLE;
+						ADC_Trigger_Start(); // Back from free-running
+					}
+					MEAS_QUERY = 0;
+					INPUT_DISCARD = 0;
 					INPUT_Clear();
 					break;
 				
@@ -117,6 +192,7 @@ int main(void) {
 					// ESC Print menu
 					PRINT_Help();
 					INPUT_Clear();
+					break;
 				
 				case 29:
 					// Ctrl-] reset all eeprom values
@@ -135,44 +211,49 @@ int main(void) {
 
 				default:
 					// Normal char buffering
-					if (DATA_IN_POS < (DATA_BUFF_LEN - 1)) {
+					if (INPUT_DISCARD) {
+						// Still the overlong line, don't parse its tail as a command
+					} else if (DATA_IN_POS < (DATA_BUFF_LEN - 1)) {
 						DATA_IN[DATA_IN_POS] = BYTE_IN;
 						DATA_IN_POS++;
 						DATA_IN[DATA_IN_POS] = 0;
 					} else {
-						// Input is too long.
-						printPGMStr(STR_Unrecognized);
+						// Input is too long. One error for the whole line.
+						PRINT_Error(ERR_LENGTH);
 						INPUT_Clear();
+						INPUT_DISCARD = 1;
 					}
 					break;
 			}
 		}
 		
+		// Drain whatever the ADC interrupt has collected since the last pass
+		ADC_Process();
+		
+		// Ship a completed capture
+		if (CAPTURE_STATE == CAPTURE_DONE && !BLOCK_Busy()) { CAPTURE_Send(); }
+		
 		// Check for above threshold current usage
-		if (schedule_read_rf && DATA_IN_POS == 0) {
-			Set_LED(1);	
-	
-			// Collect ADC_AVG_POINTS samples and average them
-			uint16_t average = 0;
-			for (uint8_t i = 0; i < ADC_AVG_POINTS; i++) {
-				average += ADC_Read_RF();
-			}
-			average = average / ADC_AVG_POINTS;
-			
-			// Convert the average reading into a voltage value referenced on ADC_V_REF
-			float temp = (average * (ADC_V_REF / 1024.0));
-			
-			// Convert the voltage value into a dBm reading
-			if (OUTPUTRAW == 0) {
-				temp = (temp / RF_FREQ_SLOPE) - RF_FREQ_INTERCEPT + 19.95;
-				fprintf(&USBSerialStream, "\r\n%.2f dBm", temp);
-			} else {
-				fprintf(&USBSerialStream, "\r\n%.3f V", temp);
-			}
-			
-			schedule_read_rf = 0;
-			
-			Set_LED(0);
+		// Take each scheduled reading on time, even while a command is being typed or a
+		// block is on the line. It stays scheduled until the first averaging window has
+		// completed. Readings are skipped while binary frames are streaming and while a
+		// capture is recording, which takes the samples away from the filter.
+		if (schedule_read_rf && STREAM_MODE == STREAM_OFF && CAPTURE_STATE == CAPTURE_IDLE) {
+			if (REPORT_Take(DATA_IN_POS != 0 || BLOCK_Busy() || BLOCK_Receiving())) { schedule_read_rf = 0; }
+		}
+		
+		// Print queued readings once the line is free, and the TX queue has room for a whole
+		// line. Otherwise they wait in the report queue rather than stall the loop.
+		while (REPORT_QUEUE_COUNT > 0 && DATA_IN_POS == 0 && !BLOCK_Busy() && !BLOCK_Receiving() &&
+		       CDC_Device_TxQueueFree(&VirtualSerial_CDC_Interface) >= REPORT_LINE_MAX) {
+			REPORT_Print_Next();
+		}
+		
+		// Answer a MEAS:POW? or FETC? once its reading is in
+		MEAS_Check();
+		if (MEAS_QUERY && MEAS_STATE == MEAS_DONE && DATA_IN_POS == 0 && !BLOCK_Busy() && !BLOCK_Receiving() &&
+		    CDC_Device_TxQueueFree(&VirtualSerial_CDC_Interface) >= REPORT_LINE_MAX) {
+			MEAS_Print();
 		}
 		
 		// Keep the LUFA USB stuff fed regularly.
@@ -180,6 +261,9 @@ int main(void) {
 		
 		// Reset the watchdog
 		wdt_reset();
+		
+		// Sleep through the next conversion in ADC Noise Reduction mode
+		if (ADC_SLEEP && CAPTURE_STATE < CAPTURE_ARMED) { ADC_Sleep_Convert(); }
 	}
 }
 
@@ -189,106 +273,425 @@ int main(void) {
 
 // Flush out our data input buffer, reset our position variable, and print a new prompt.
 static inline void INPUT_Clear(void) {
-	memset(&DATA_IN[0], 0, sizeof(DATA_IN));
+	memset(&DATA_IN[0], 0, DATA_BUFF_LEN);
 	DATA_IN_POS = 0;
 	
-	fprintf(&USBSerialStream, "\r\n\r\n");
+	if (!MACHINE_MODE) { fprintf_P(&USBSerialStream, PSTR("\r\n\r\n")); }
+	USB_Flush();
 }
 
-// Parse out a single number argument
-static inline long INPUT_Parse_num() {
-	long temp = 0;
+// Parse out a single number argument at the cursor, moving the cursor past it.
+// Returns 0, leaving the cursor at the next non-separator, if there isn't a number there.
+static inline uint8_t INPUT_Parse_num(const char ** cursor, long * value) {
+	const char * pos = *cursor;
 	uint8_t negative = 0;
-	uint8_t num_started = 0;
-	
-	while (*DATA_IN != 0) {
-		if (num_started == 0) { // Number hasn't started yet. Skip through non-number chars.
-			if (*DATA_IN == '-') { negative = 1; num_started = 1; }
-			if (*DATA_IN == '+') { negative = 0; num_started = 1; }
-			if (*DATA_IN >= '0' && *DATA_IN <= '9') { temp = (temp * 10) + (*DATA_IN - '0'); num_started = 1; }
-		} else { // Number has started. Continue reading until we hit a non-number.
-			if (*DATA_IN >= '0' && *DATA_IN <= '9') {
-				temp = (temp * 10) + (*DATA_IN - '0');
-			} else {
-				break;
-			}
-		}
-		DATA_IN++;	
-	}
+	long temp = 0;
+	
+	// Arguments are separated by spaces or commas
+	while (*pos == ' ' || *pos == ',') { pos++; }
+	*cursor = pos;
 	
-	if (negative) { temp = temp * -1; }
+	if (*pos == '-' || *pos == '+') { negative = (*pos++ == '-'); }
+	if (*pos < '0' || *pos > '9') { return 0; }
+	while (*pos >= '0' && *pos <= '9') {
+		// Saturate rather than overflow, it will be out of range anyway
+		if (temp < 100000000L) { temp = (temp * 10) + (*pos - '0'); }
+		pos++;
+	}
 	
-	return temp;
+	*value = negative ? -temp : temp;
+	*cursor = pos;
+	return 1;
 }
 
 // We've gotten a new command, parse out what they want.
+// The command name is looked up in CMD_TABLE, and its arguments parsed and range checked
+// here, before the handler is called. Entries flagged CMD_FLAG_SCPI don't get an OK or ERR
+// line, their errors are only queued for SYST:ERR?.
 static inline void INPUT_Parse(void) {
-	// HELP - Print a basic help menu
-	if (strncasecmp_P(DATA_IN, STR_Command_HELP, 4) == 0) {
-		PRINT_Help();
-		return;
-	}
-	// DEBUG - Print a report of debugging information, including EEPROM variables
-	if (strncasecmp_P(DATA_IN, STR_Command_DEBUG, 10) == 0) {
-		DEBUG_Dump();
-		return;
-	}
-	// SETSLOPE - Update calibration slope value for the given frequency
-	if (strncasecmp_P(DATA_IN, STR_Command_SETSLOPE, 8) == 0) {
-		DATA_IN += 8;
-		long span = INPUT_Parse_num();
-		long slope = INPUT_Parse_num();
-		if (span >= 0 && span <= 26 && slope >= 160 && slope <= 180) {
-			EEPROM_Write_RF_Cal_Slope(span, (float)(slope / 10000.0));
-			printPGMStr(STR_Slope_Set);
-			return;
-		}
+	char name[CMD_NAME_LEN + 1];
+	const char * cursor = DATA_IN;
+	uint8_t length = 0;
+	uint8_t low = 0;
+	uint8_t high = CMD_TABLE_LEN;
+	CMD_Entry_t entry;
+	long args[CMD_ARGS_MAX];
+	uint8_t count = 0;
+	uint8_t error = ERR_UNKNOWN;
+	uint8_t flags = 0;
+	
+	// Command names are the leading letters and SCPI punctuation, matched in upper case
+	while ((*cursor >= 'A' && *cursor <= 'Z') || (*cursor >= 'a' && *cursor <= 'z') ||
+	       *cursor == '*' || *cursor == ':' || *cursor == '?') {
+		if (length == CMD_NAME_LEN) { length = 0; break; }
+		name[length++] = (*cursor >= 'a') ? (*cursor & ~0x20) : *cursor;
+		cursor++;
 	}
-	// SETINTERCEPT - Update calibration intercept value for the given frequency	
-	if (strncasecmp_P(DATA_IN, STR_Command_SETINTERCEPT, 12) == 0) {
-		DATA_IN += 12;
-		long span = INPUT_Parse_num();
-		long intercept = INPUT_Parse_num();
-		if (span >= 0 && span <= 26 && intercept >= 65 && intercept <= 75) {
-			EEPROM_Write_RF_Cal_Intercept(span, intercept);
-			printPGMStr(STR_Intercept_Set);
-			return;
+	name[length] = 0;
+	
+	// Binary search the sorted table
+	while (low < high) {
+		uint8_t mid = (low + high) / 2;
+		int order = strcmp_P(name, (PGM_P)pgm_read_word(&CMD_TABLE[mid].Name));
+		
+		if (order == 0) {
+			memcpy_P(&entry, &CMD_TABLE[mid], sizeof(entry));
+			flags = entry.Flags;
+			
+			// Collect the arguments, and check there's nothing after them
+			error = ERR_ARGS;
+			while (count < CMD_ARGS_MAX && INPUT_Parse_num(&cursor, &args[count])) { count++; }
+			if (*cursor != 0 || count < entry.Args || count > entry.Args + entry.Optional) { break; }
+			
+			error = ERR_RANGE;
+			for (uint8_t i = 0; i < count; i++) {
+				if (args[i] < entry.Min[i] || args[i] > entry.Max[i]) { count = 0xFF; }
+			}
+			if (count == 0xFF) { break; }
+			
+			error = ERR_STATE;
+			if (entry.Handler(count, args)) {
+				if (!(entry.Flags & CMD_FLAG_SCPI)) { PRINT_OK(); }
+				return;
+			}
+			break;
 		}
-	}
-	// OUTPUTRAW - Toggle outputting raw voltage values instead of the calculated dBm values
-	if (strncasecmp_P(DATA_IN, STR_Command_OUTPUTRAW, 9) == 0) {
-		if (OUTPUTRAW == 0) {
-			OUTPUTRAW = 1;
+		if (order < 0) {
+			high = mid;
 		} else {
-			OUTPUTRAW = 0;
+			low = mid + 1;
 		}
-		return;
 	}
-	// F - Set frequency to help calibrate readings
-	if (*DATA_IN == 'F' || *DATA_IN == 'f') {
-		DATA_IN += 1;
-		uint16_t temp_freq = atoi(DATA_IN);
-		if (temp_freq >= 1 && temp_freq < 2700) {
-			printPGMStr(STR_Load_Cal);
-			fprintf(&USBSerialStream, "%i", temp_freq);
-			Load_RF_Calibration(temp_freq);
-			return;
-		}
+	
+	// If none of the above commands were recognized, print a generic error.
+	if (flags & CMD_FLAG_SCPI) {
+		ERROR_Push(error);
+	} else {
+		PRINT_Error(error);
+	}
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Command Handlers
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Called by INPUT_Parse() with count arguments, already checked against the table ranges.
+// Return 0 to reject the command as invalid.
+
+// *IDN? - Identify the instrument
+static uint8_t CMD_Idn(uint8_t count, const long * args) {
+	PRINT_Line_Start();
+	printPGMStr(STR_IDN);
+	PRINT_Line_End();
+	return 1;
+}
+
+// ADCSLEEP - Take conversions in ADC Noise Reduction sleep, or back at the SRATE.
+// Timer 0 stops during the sleep, so the sleep paces conversions instead.
+static uint8_t CMD_ADCSleep(uint8_t count, const long * args) {
+	ADC_SLEEP = args[0];
+	ADC_Start_RF();
+	return 1;
+}
+
+// AVG - Set the averaging window
+static uint8_t CMD_Avg(uint8_t count, const long * args) {
+	if (!MACHINE_MODE) {
+		printPGMStr(STR_Avg_Set);
+		fprintf_P(&USBSerialStream, PSTR("%u samples."), (uint16_t)args[0]);
+	}
+	AVG_WINDOW = args[0];
+	ADC_Filter_Reset();
+	return 1;
+}
+
+// BURST - Capture raw samples, immediately or triggered by a level in dBm
+static uint8_t CMD_Burst(uint8_t count, const long * args) {
+	if (STREAM_MODE != STREAM_OFF || FIT_Holding()) { return 0; } // A capture takes the samples, the pacing and the buffer
+	if (!MACHINE_MODE) { printPGMStr(STR_Capture_Armed); }
+	CAPTURE_Start(0, args[0], (count > 1) ? (int16_t)args[1] * 100 : INT16_MIN);
+	return 1;
+}
+
+// CALCLEAR - Discard the measured reference levels
+static uint8_t CMD_CalClear(uint8_t count, const long * args) {
+	FIT_COUNT = 0;
+	FIT_LEFT = 0;
+	return 1;
+}
+
+// CALFIT - Fit the measured reference levels and save the calibration
+static uint8_t CMD_CalFit(uint8_t count, const long * args) {
+	if (FIT_LEFT != 0) { return 0; } // Wait for the point being measured, see CALSTATUS
+	FIT_Spans();
+	return 1;
+}
+
+// CALGET - Send the calibration table as a binary block
+static uint8_t CMD_CalGet(uint8_t count, const long * args) {
+	BLOCK_Start(BLOCK_TYPE_CAL, RF_CAL_SPANS, CAL_POINTS, sizeof(CAL_POINTS));
+	return 1;
+}
+
+// CALPOINT - Measure a reference level for the calibration fit. A span's values apply at
+// its centre frequency, so only that is accepted.
+static uint8_t CMD_CalPoint(uint8_t count, const long * args) {
+	uint8_t span = args[0] / RF_CAL_SPAN_MHZ;
+	if (args[0] % RF_CAL_SPAN_MHZ != RF_CAL_SPAN_MHZ / 2) { return 0; }
+	if (FIT_LEFT != 0 || CAPTURE_STATE != CAPTURE_IDLE) { return 0; }
+	if (FIT_COUNT > 0 && FIT_SPANS[span].Count >= FIT_SPAN_POINTS_MAX) { return 0; }
+	if (!MACHINE_MODE) { printPGMStr(STR_Fit_Measuring); }
+	FIT_Start(span, args[1]);
+	return 1;
+}
+
+// CALPUT - Receive a calibration table as a binary block. It is staged in the idle
+// capture buffer and only committed once its CRC checks out.
+static uint8_t CMD_CalPut(uint8_t count, const long * args) {
+	if (CAPTURE_STATE != CAPTURE_IDLE || FIT_Holding()) { return 0; }
+	if (!MACHINE_MODE) { printPGMStr(STR_Cal_Ready); }
+	BLOCK_Receive_Start(BLOCK_TYPE_CAL, CAPTURE_BUFF, sizeof(CAL_POINTS));
+	return 1;
+}
+
+// CALSTATUS - Samples left for the reference level being measured, points summed so far
+// and the mean detector voltage of the last one
+static uint8_t CMD_CalStatus(uint8_t count, const long * args) {
+	PRINT_Line_Start();
+	fprintf_P(&USBSerialStream, PSTR("left %u\tpoints %u\tlast "), FIT_LEFT, FIT_COUNT);
+	PRINT_Fixed(FIT_VOLTAGE, 6);
+	PRINT_Line_End();
+	return 1;
+}
+
+// CCDF - Print the CCDF of the power histogram
+static uint8_t CMD_CCDF(uint8_t count, const long * args) {
+	// An empty histogram is an error to a script, and already explained to a person
+	return HIST_Print_CCDF() || !MACHINE_MODE;
+}
+
+// DEBUG - Print a report of debugging information, including EEPROM variables
+static uint8_t CMD_Debug(uint8_t count, const long * args) {
+	DEBUG_Dump();
+	return 1;
+}
+
+// EVERY - Print a reading every N samples instead of on a timer
+static uint8_t CMD_Every(uint8_t count, const long * args) {
+	if (!MACHINE_MODE) {
+		printPGMStr(STR_Rate_Set);
+		fprintf_P(&USBSerialStream, PSTR("%u samples."), (uint16_t)args[0]);
+	}
+	REPORT_MODE = REPORT_SAMPLES;
+	REPORT_EVERY = args[0];
+	REPORT_SAMPLE_COUNT = 0;
+	ADC_Stats_Reset();
+	return 1;
+}
+
+// F - Set frequency to help calibrate readings
+static uint8_t CMD_Freq(uint8_t count, const long * args) {
+	if (!MACHINE_MODE) {
+		printPGMStr(STR_Load_Cal);
+		fprintf_P(&USBSerialStream, PSTR("%u"), (uint16_t)args[0]);
+	}
+	Load_RF_Calibration(args[0]);
+	return 1;
+}
+
+// FETC? - Print the result of the last TRIG, once it has completed
+static uint8_t CMD_Fetch(uint8_t count, const long * args) {
+	if (MEAS_STATE == MEAS_IDLE) { return 0; }
+	MEAS_QUERY = 1;
+	return 1;
+}
+
+// FILTER - Select the filter stage, and its shift
+static uint8_t CMD_Filter(uint8_t count, const long * args) {
+	static const uint8_t shift_max[] = {0, FILTER_EMA_SHIFT_MAX, FILTER_BOXCAR_SHIFT_MAX, FILTER_CIC_SHIFT_MAX};
+	uint8_t mode = args[0];
+	uint8_t shift = (count > 1) ? args[1] : 0;
+	
+	if (mode != FILTER_MEAN && (shift < 1 || shift > shift_max[mode])) { return 0; }
+	if (!MACHINE_MODE) { printPGMStr(STR_Filter_Set); }
+	FILTER_MODE = mode;
+	FILTER_SHIFT = (mode == FILTER_MEAN) ? 0 : shift;
+	ADC_Filter_Reset();
+	return 1;
+}
+
+#ifdef FLOAT_REFERENCE
+	// FLOATREF - Toggle printing the floating point reference conversion next to each reading
+	static uint8_t CMD_FloatRef(uint8_t count, const long * args) {
+		FLOATREF = !FLOATREF;
+		return 1;
+	}
+#endif
+
+// HELP - Print a basic help menu
+static uint8_t CMD_Help(uint8_t count, const long * args) {
+	PRINT_Help();
+	return 1;
+}
+
+// HIST - Send the power histogram as a binary block
+static uint8_t CMD_Hist(uint8_t count, const long * args) {
+	BLOCK_Start(BLOCK_TYPE_HIST, ((uint16_t)ADC_OVERSAMPLE << 8) | HIST_SHIFT, HIST_BINS, sizeof(HIST_BINS));
+	return 1;
+}
+
+// HISTRESET - Clear the power histogram
+static uint8_t CMD_HistReset(uint8_t count, const long * args) {
+	HIST_Reset();
+	return 1;
+}
+
+// INTERVAL - Set data printing rate in milliseconds
+static uint8_t CMD_Interval(uint8_t count, const long * args) {
+	if (!MACHINE_MODE && args[0] > 0) {
+		printPGMStr(STR_Rate_Set);
+		fprintf_P(&USBSerialStream, PSTR("%lu ms."), (unsigned long)args[0]);
+	}
+	if (!MACHINE_MODE && args[0] == 0) { printPGMStr(STR_Reports_Off); }
+	Set_Report_Interval(args[0]);
+	return 1;
+}
+
+// MACHINE - Switch to terse output for scripted hosts, or back to the interactive console
+static uint8_t CMD_Machine(uint8_t count, const long * args) {
+	MACHINE_MODE = args[0];
+	return 1;
+}
+
+// MEAS:POW? - Take a fresh reading and print it
+static uint8_t CMD_Measure(uint8_t count, const long * args) {
+	MEAS_Start();
+	MEAS_QUERY = 1;
+	return 1;
+}
+
+// OUTPUTRAW - Toggle outputting raw voltage values instead of the calculated dBm values
+static uint8_t CMD_OutputRaw(uint8_t count, const long * args) {
+	OUTPUTRAW = !OUTPUTRAW;
+	return 1;
+}
+
+// OVERSAMPLE - Set the number of extra bits gained by oversampling and decimation
+static uint8_t CMD_Oversample(uint8_t count, const long * args) {
+	if (!MACHINE_MODE) {
+		printPGMStr(STR_Oversample_Set);
+		fprintf_P(&USBSerialStream, PSTR("%i bits."), ADC_BITS + (uint8_t)args[0]);
 	}
-	// R - Set data printing rate
-	if (*DATA_IN == 'R' || *DATA_IN == 'r') {
-		DATA_IN += 1;
-		uint16_t temp_rate = atoi(DATA_IN);
-		if (temp_rate >= 1 && temp_rate <= 10) {
+	ADC_OVERSAMPLE = args[0];
+	ADC_Start_RF();
+	return 1;
+}
+
+// PAPR - Print the peak to average power ratio of the power histogram
+static uint8_t CMD_PAPR(uint8_t count, const long * args) {
+	// An empty histogram is an error to a script, and already explained to a person
+	return HIST_Print_PAPR() || !MACHINE_MODE;
+}
+
+// R - Set data printing rate in seconds
+static uint8_t CMD_Rate(uint8_t count, const long * args) {
+	if (!MACHINE_MODE) {
+		if (args[0] > 0) {
 			printPGMStr(STR_Rate_Set);
-			fprintf(&USBSerialStream, "%i seconds.", temp_rate);
-			PRINTING_RATE = temp_rate;
-			return;
+			fprintf_P(&USBSerialStream, PSTR("%u seconds."), (uint16_t)args[0]);
+		} else {
+			printPGMStr(STR_Reports_Off);
+		}
+	}
+	Set_Report_Interval((uint32_t)args[0] * TICKS_PER_SECOND);
+	return 1;
+}
+
+// SETINTERCEPT - Update calibration intercept value for the given frequency
+static uint8_t CMD_SetIntercept(uint8_t count, const long * args) {
+	EEPROM_Write_RF_Cal_Intercept(args[0], args[1]);
+	Load_RF_Calibration(RF_FREQ); // The span may be one the current frequency uses
+	if (!MACHINE_MODE) { printPGMStr(STR_Intercept_Set); }
+	return 1;
+}
+
+// SETSLOPE - Update calibration slope value for the given frequency
+static uint8_t CMD_SetSlope(uint8_t count, const long * args) {
+	EEPROM_Write_RF_Cal_Slope(args[0], args[1]);
+	Load_RF_Calibration(RF_FREQ); // The span may be one the current frequency uses
+	if (!MACHINE_MODE) { printPGMStr(STR_Slope_Set); }
+	return 1;
+}
+
+// SRATE - Start conversions from timer 0 at a fixed rate in Hz, or free-running (0)
+static uint8_t CMD_SRate(uint8_t count, const long * args) {
+	if (args[0] > 0 && args[0] < ADC_TIMER_HZ_MIN) { return 0; }
+	if (ADC_SLEEP) { return 0; }
+	ADC_TIMER_HZ = args[0];
+	ADC_Start_RF();
+	if (!MACHINE_MODE) {
+		printPGMStr(STR_SRate_Set);
+		if (ADC_TIMER_CHZ > 0) {
+			PRINT_Fixed(ADC_TIMER_CHZ, 2);
+			printPGMStr(PSTR(" Hz."));
+		} else {
+			printPGMStr(PSTR("free-running."));
 		}
 	}
+	return 1;
+}
+
+// STATS - Toggle printing the interval statistics with each reading
+static uint8_t CMD_Stats(uint8_t count, const long * args) {
+	STATS = !STATS;
+	return 1;
+}
+
+// STREAM - Start or stop binary sample streaming
+static uint8_t CMD_Stream(uint8_t count, const long * args) {
+	if (args[0] != STREAM_OFF && CAPTURE_STATE != CAPTURE_IDLE) { return 0; }
+	STREAM_Start(args[0]);
+	return 1;
+}
+
+// SYST:ERR? - Print and remove the oldest queued error
+static uint8_t CMD_SystErr(uint8_t count, const long * args) {
+	uint8_t code = ERROR_Pop();
 	
-	// If none of the above commands were recognized, print a generic error.
-	printPGMStr(STR_Unrecognized);
+	PRINT_Line_Start();
+	fprintf_P(&USBSerialStream, PSTR("%i,\""), (int16_t)pgm_read_word(&ERROR_TABLE[code].Code));
+	printPGMStr((PGM_P)pgm_read_word(&ERROR_TABLE[code].Message));
+	printPGMStr(PSTR("\""));
+	PRINT_Line_End();
+	return 1;
+}
+
+// TEMP - Supply the current temperature
+static uint8_t CMD_Temp(uint8_t count, const long * args) {
+	TEMP_Set(args[0]);
+	return 1;
+}
+
+// TEMPCO - Save the temperature coefficient and calibration temperature
+static uint8_t CMD_TempCo(uint8_t count, const long * args) {
+	TEMP_CO = args[0];
+	TEMP_REF = args[1];
+	TEMP_Save();
+	RF_Cal_Offset_Update();
+	return 1;
+}
+
+// TRIG - Start a fresh reading, for FETC? to collect
+static uint8_t CMD_Trig(uint8_t count, const long * args) {
+	MEAS_Start();
+	return 1;
+}
+
+// TRIGGER - Capture raw samples before and after the input rises through a level in dBm
+static uint8_t CMD_Trigger(uint8_t count, const long * args) {
+	if (args[0] + args[1] > CAPTURE_BUFF_LEN || STREAM_MODE != STREAM_OFF || FIT_Holding()) { return 0; }
+	if (!MACHINE_MODE) { printPGMStr(STR_Capture_Armed); }
+	CAPTURE_Start(args[0], args[1], (int16_t)args[2] * 100);
+	return 1;
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -302,7 +705,9 @@ static inline void PRINT_Status(void) {
 
 // Print a quick help command
 static inline void PRINT_Help(void) {
+	PRINT_Line_Start();
 	printPGMStr(STR_Help_Info);
+	PRINT_Line_End();
 }
 
 // Print a PGM stored string
@@ -311,6 +716,83 @@ static inline void printPGMStr(PGM_P s) {
 	while((c = pgm_read_byte(s++)) != 0) fputc(c, &USBSerialStream);
 }
 
+// Print a fixed point value with the given number of decimal places, ie. -1234, 2 -> "-12.34"
+static inline void PRINT_Fixed(int32_t value, uint8_t decimals) {
+	char buff[14];
+	uint8_t pos = sizeof(buff) - 1;
+	uint8_t digits = 0;
+	uint32_t mag = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+	
+	buff[pos] = 0;
+	do {
+		if (digits == decimals && digits > 0) { buff[--pos] = '.'; }
+		buff[--pos] = '0' + (mag % 10);
+		mag /= 10;
+		digits++;
+	} while (mag > 0 || digits <= decimals);
+	if (value < 0) { buff[--pos] = '-'; }
+	
+	fputs(&buff[pos], &USBSerialStream);
+}
+
+// Acknowledge a command. Only machine mode says so.
+static inline void PRINT_OK(void) {
+	if (MACHINE_MODE) { printPGMStr(PSTR("OK\r\n")); }
+}
+
+// Report a failed command, as a numbered error in machine mode. It is queued for SYST:ERR? too.
+static inline void PRINT_Error(uint8_t code) {
+	ERROR_Push(code);
+	if (MACHINE_MODE) {
+		fprintf_P(&USBSerialStream, PSTR("ERR %u\r\n"), code);
+	} else {
+		printPGMStr(STR_Unrecognized);
+	}
+}
+
+// Start and end a line of results. Machine mode ends lines instead of starting them, so
+// each line is complete as soon as it arrives.
+static inline void PRINT_Line_Start(void) {
+	if (!MACHINE_MODE) { printPGMStr(PSTR("\r\n")); }
+}
+
+static inline void PRINT_Line_End(void) {
+	if (MACHINE_MODE) { printPGMStr(PSTR("\r\n")); }
+	USB_Flush();
+}
+
+// Queue an error for SYST:ERR?. When full the newest is replaced by a queue overflow.
+static inline void ERROR_Push(uint8_t code) {
+	if (ERROR_QUEUE_COUNT == ERROR_QUEUE_LEN) {
+		ERROR_QUEUE[(ERROR_QUEUE_HEAD + ERROR_QUEUE_LEN - 1) % ERROR_QUEUE_LEN] = ERR_OVERFLOW;
+		return;
+	}
+	ERROR_QUEUE[(ERROR_QUEUE_HEAD + ERROR_QUEUE_COUNT) % ERROR_QUEUE_LEN] = code;
+	ERROR_QUEUE_COUNT++;
+}
+
+// Take the oldest queued error, ERR_NONE if there are none
+static inline uint8_t ERROR_Pop(void) {
+	uint8_t code;
+	
+	if (ERROR_QUEUE_COUNT == 0) { return ERR_NONE; }
+	code = ERROR_QUEUE[ERROR_QUEUE_HEAD];
+	ERROR_QUEUE_HEAD = (ERROR_QUEUE_HEAD + 1) % ERROR_QUEUE_LEN;
+	ERROR_QUEUE_COUNT--;
+	return code;
+}
+
+// Print a reading in ADC counts as dBm, or as volts in OUTPUTRAW mode
+static inline void PRINT_Level(uint16_t counts) {
+	if (OUTPUTRAW == 0) {
+		PRINT_Fixed(RF_Counts_To_cdBm(counts), 2);
+		printPGMStr(PSTR(" dBm"));
+	} else {
+		PRINT_Fixed(RF_Counts_To_mV(counts), 3);
+		printPGMStr(PSTR(" V"));
+	}
+}
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // ~~ EEPROM Functions
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ 
@@ -324,55 +806,232 @@ static inline void EEPROM_Reset(void) {
 
 // Initialize the EEPROM with default calibration values
 static inline void EEPROM_Init(void) {
-	for (uint8_t i = 0; i < 27; i++) {
-		eeprom_update_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_SLOPE + i), RF_CAL_DEFAULTS_SLOPE[i]);
-		eeprom_update_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_INTERCEPT + i), RF_CAL_DEFAULTS_INTERCEPT[i]);
+	for (uint8_t i = 0; i < RF_CAL_SPANS; i++) {
+		CAL_POINTS[i].Slope = RF_CAL_DEFAULTS_SLOPE[i] * 100U;
+		CAL_POINTS[i].Intercept = RF_CAL_DEFAULTS_INTERCEPT[i] * 100;
+	}
+	EEPROM_Cal_Save();
+	
+	// No temperature correction until one is measured
+	TEMP_CO = 0;
+	TEMP_REF = TEMP_REF_DEFAULT;
+	TEMP_Save();
+}
+
+// Convert the version 1 calibration bytes (0.0001 V/dB and whole dB) into the version 2 table
+static inline void EEPROM_Migrate_V1(void) {
+	for (uint8_t i = 0; i < RF_CAL_SPANS; i++) {
+		uint8_t slope = eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_SLOPE + i));
+		uint8_t intercept = eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_INTERCEPT + i));
+		// Out of range (uninitialized) values took the defaults in version 1 too
+		if (slope < 160 || slope > 180) slope = 173;
+		if (intercept < 65 || intercept > 75) intercept = 68;
+		
+		CAL_POINTS[i].Slope = slope * 100U;
+		CAL_POINTS[i].Intercept = intercept * 100;
+	}
+	EEPROM_Cal_Save();
+	
+	// Version 1 had no temperature correction
+	TEMP_CO = 0;
+	TEMP_REF = TEMP_REF_DEFAULT;
+	TEMP_Save();
+}
+
+// CRC16 of the calibration points in RAM
+static inline uint16_t EEPROM_Cal_CRC(void) {
+	uint16_t crc = 0;
+	for (uint8_t i = 0; i < sizeof(CAL_POINTS); i++) {
+		crc = _crc_xmodem_update(crc, ((const uint8_t *)CAL_POINTS)[i]);
+	}
+	return crc;
+}
+
+// Read the calibration table into RAM, once at boot, and check it against its header.
+// Points out of range are defaulted here, so lookups don't need to check them.
+static inline uint8_t EEPROM_Cal_Load(void) {
+	CAL_Header_t header;
+	uint8_t valid;
+	
+	eeprom_read_block(&header, (const void*)(EEPROM_OFFSET_CAL_TABLE), sizeof(header));
+	eeprom_read_block(CAL_POINTS, (const void*)(EEPROM_OFFSET_CAL_POINTS), sizeof(CAL_POINTS));
+	valid = header.Version == EEPROM_VERS && header.Count == RF_CAL_SPANS && header.CRC == EEPROM_Cal_CRC();
+	
+	for (uint8_t i = 0; i < RF_CAL_SPANS; i++) {
+		// If the value seems out of range, default it to 0.0173 V/dB
+		if (CAL_POINTS[i].Slope < RF_CAL_SLOPE_MIN || CAL_POINTS[i].Slope > RF_CAL_SLOPE_MAX) CAL_POINTS[i].Slope = RF_CAL_SLOPE_DEFAULT;
+		// If the value seems out of range, default it to 68 dB
+		if (CAL_POINTS[i].Intercept < RF_CAL_INTERCEPT_MIN || CAL_POINTS[i].Intercept > RF_CAL_INTERCEPT_MAX) CAL_POINTS[i].Intercept = RF_CAL_INTERCEPT_DEFAULT;
 	}
+	return valid;
+}
+
+// Write the whole RAM table to the EEPROM
+static inline void EEPROM_Cal_Save(void) {
+	eeprom_update_block(CAL_POINTS, (void*)(EEPROM_OFFSET_CAL_POINTS), sizeof(CAL_POINTS));
+	EEPROM_Cal_Seal();
 }
 
-// Handle read/write of the RF slope value from EEPROM based on what frequency span we're in
-static inline void EEPROM_Write_RF_Cal_Slope(uint8_t span, float value) {
-	eeprom_update_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_SLOPE + span), (int)(value * 10000));
+// Check an uploaded calibration table, then commit it to RAM and EEPROM in one pass
+static inline uint8_t EEPROM_Cal_Put(const BLOCK_Header_t * header, const CAL_Point_t * points) {
+	if (header->Param != RF_CAL_SPANS || header->Length != sizeof(CAL_POINTS)) { return 0; }
+	for (uint8_t i = 0; i < RF_CAL_SPANS; i++) {
+		if (points[i].Slope < RF_CAL_SLOPE_MIN || points[i].Slope > RF_CAL_SLOPE_MAX) { return 0; }
+		if (points[i].Intercept < RF_CAL_INTERCEPT_MIN || points[i].Intercept > RF_CAL_INTERCEPT_MAX) { return 0; }
+	}
+	
+	memcpy(CAL_POINTS, points, sizeof(CAL_POINTS));
+	EEPROM_Cal_Save();
+	Load_RF_Calibration(RF_FREQ);
+	return 1;
 }
-static inline float EEPROM_Read_RF_Cal_Slope(uint8_t span) {
-	uint8_t RF_CAL_SLOPE = eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_SLOPE + span));
-	// If the value seems out of range (uninitialized), default it to 0.0173
-	if (RF_CAL_SLOPE < 160 || RF_CAL_SLOPE > 180) RF_CAL_SLOPE = 173;
-	return (float)RF_CAL_SLOPE / 10000.0;
+
+// Write the calibration table header to match the points
+static inline void EEPROM_Cal_Seal(void) {
+	CAL_Header_t header = {EEPROM_VERS, RF_CAL_SPANS, EEPROM_Cal_CRC()};
+	eeprom_update_block(&header, (void*)(EEPROM_OFFSET_CAL_TABLE), sizeof(header));
 }
 
-// Handle read/write of the RF intercept value from EEPROM based on what frequency span we're in
-static inline void EEPROM_Write_RF_Cal_Intercept(uint8_t span, uint8_t value) {
-	eeprom_update_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_INTERCEPT + span), value);
+// Update the RF slope value for a frequency span, in RAM and EEPROM
+// Slope values are stored in units of uV/dB
+static inline void EEPROM_Write_RF_Cal_Slope(uint8_t span, uint16_t value) {
+	CAL_POINTS[span].Slope = value;
+	eeprom_update_word((uint16_t*)(EEPROM_OFFSET_CAL_POINTS + span * sizeof(CAL_Point_t) + offsetof(CAL_Point_t, Slope)), value);
+	EEPROM_Cal_Seal();
 }
-static inline uint8_t EEPROM_Read_RF_Cal_Intercept(uint8_t span) {
-	uint8_t RF_CAL_INTERCEPT = eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_RF_CAL_INTERCEPT + span));
-	// If the value seems out of range (uninitialized), default it to 68
-	if (RF_CAL_INTERCEPT < 65 || RF_CAL_INTERCEPT > 75) RF_CAL_INTERCEPT = 68;
-	return RF_CAL_INTERCEPT;
+
+// Update the RF intercept value for a frequency span, in RAM and EEPROM
+// Intercept values are stored in units of 0.01 dB
+static inline void EEPROM_Write_RF_Cal_Intercept(uint8_t span, int16_t value) {
+	CAL_POINTS[span].Intercept = value;
+	eeprom_update_word((uint16_t*)(EEPROM_OFFSET_CAL_POINTS + span * sizeof(CAL_Point_t) + offsetof(CAL_Point_t, Intercept)), value);
+	EEPROM_Cal_Seal();
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // ~~ Debugging Functions
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+// Fill the RAM above .bss with STACK_PAINT before anything runs. In .init1, ahead of
+// the C runtime setting up r1, so it is plain assembly: loop Z from _end up to __stack.
+void DEBUG_Stack_Paint(void) {
+	__asm__ __volatile__ (
+		"ldi r30, lo8(_end)\n\t"
+		"ldi r31, hi8(_end)\n\t"
+		"ldi r24, %0\n\t"
+		"ldi r25, hi8(__stack)\n\t"
+		"rjmp 2f\n"
+		"1:\n\t"
+		"st Z+, r24\n"
+		"2:\n\t"
+		"cpi r30, lo8(__stack)\n\t"
+		"cpc r31, r25\n\t"
+		"brlo 1b\n\t"
+		"breq 1b"
+		:: "M" (STACK_PAINT));
+}
+
+// Count the painted bytes left between the top of the heap and the deepest the stack
+// has been. Anything the stack ever overwrote is gone, so this is the worst case headroom.
+static inline uint16_t DEBUG_Stack_Unused(void) {
+	const uint8_t * p = (__brkval != NULL) ? (const uint8_t *)__brkval : &_end;
+	uint16_t count = 0;
+	
+	while (p <= &__stack && *p == STACK_PAINT) {
+		p++;
+		count++;
+	}
+	return count;
+}
+
 // Dump debugging data
 static inline void DEBUG_Dump(void) {
 	// Print hardware and software versions
-	fprintf(&USBSerialStream, "\r\nHW V%s, SW V%s", HARDWARE_VERS, SOFTWARE_VERS);
+	PRINT_Line_Start();
+	fprintf_P(&USBSerialStream, PSTR("HW V%s, SW V%s"), HARDWARE_VERS, SOFTWARE_VERS);
 	
 	// Print eeprom version
-	fprintf(&USBSerialStream, "\r\nEEPROM V%i", eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_EEPROM_INIT)));
+	fprintf_P(&USBSerialStream, PSTR("\r\nEEPROM V%i"), eeprom_read_byte((uint8_t*)(EEPROM_OFFSET_EEPROM_INIT)));
+	
+	// Print samples dropped because the main loop fell behind the ADC
+	fprintf_P(&USBSerialStream, PSTR("\r\nSample overflows: %i"), SAMPLES_OVERFLOW);
+	
+	// Print how much RAM the stack has never reached since reset
+	fprintf_P(&USBSerialStream, PSTR("\r\nStack headroom: %u bytes"), DEBUG_Stack_Unused());
+	
+	// Print the conversion clock
+	printPGMStr(PSTR("\r\nConversion clock: "));
+	if (ADC_TIMER_CHZ > 0) {
+		PRINT_Fixed(ADC_TIMER_CHZ, 2);
+		printPGMStr(PSTR(" Hz"));
+	} else {
+		printPGMStr(ADC_SLEEP ? PSTR("sleep") : PSTR("free-running"));
+	}
+	
+	// Print output dropped because the host wasn't reading
+	fprintf_P(&USBSerialStream, PSTR("\r\nTX bytes dropped: %u"), VirtualSerial_CDC_Interface.State.TxDropped);
+	fprintf_P(&USBSerialStream, PSTR("\r\nStream frames dropped: %u"), STREAM_DROPPED);
+	fprintf_P(&USBSerialStream, PSTR("\r\nReadings dropped: %u"), REPORT_DROPPED);
 	
 	// Print current calibration values
-	printPGMStr(PSTR("\r\n\r\nCurrent Calibration Values: "));
-	fprintf(&USBSerialStream, "%.4f - %i", RF_FREQ_SLOPE, RF_FREQ_INTERCEPT);
+	fprintf_P(&USBSerialStream, PSTR("\r\n\r\nCurrent Calibration Values (%u MHz): "), RF_FREQ);
+	PRINT_Fixed(RF_FREQ_SLOPE, 6);
+	printPGMStr(PSTR(" - "));
+	PRINT_Fixed(RF_FREQ_INTERCEPT, 2);
+	fprintf_P(&USBSerialStream, PSTR(" (gain %u, offset %i)"), RF_CAL_GAIN, RF_CAL_OFFSET);
+	
+	// Print temperature correction
+	printPGMStr(PSTR("\r\nTemperature: "));
+	if (TEMP_VALID) {
+		PRINT_Fixed(TEMP_NOW, 2);
+	} else {
+		printPGMStr(PSTR("unknown"));
+	}
+	printPGMStr(PSTR(", drift "));
+	PRINT_Fixed(TEMP_CO, 3);
+	printPGMStr(PSTR(" dB/C from "));
+	PRINT_Fixed(TEMP_REF, 2);
 	
 	// Print stored calibration values
 	printPGMStr(PSTR("\r\n\r\nStored Calibration Values:"));
-	for (uint8_t i = 0; i < 27; i++) {
-		fprintf(&USBSerialStream, "\r\n%i:\t%.4f\t%i", i, EEPROM_Read_RF_Cal_Slope(i), EEPROM_Read_RF_Cal_Intercept(i));
+	for (uint8_t i = 0; i < RF_CAL_SPANS; i++) {
+		fprintf_P(&USBSerialStream, PSTR("\r\n%i:\t"), i);
+		PRINT_Fixed(CAL_POINTS[i].Slope, 6);
+		printPGMStr(PSTR("\t"));
+		PRINT_Fixed(CAL_POINTS[i].Intercept, 2);
 	}
+	PRINT_Line_End();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Measurement Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Throw away the filter history and start a single reading, taken over the next
+// averaging window (or filter settling) rather than waiting for the next report.
+// The periodic reports share the filter, so their current window restarts too.
+static inline void MEAS_Start(void) {
+	ADC_Filter_Reset();
+	MEAS_STATE = MEAS_RUNNING;
+}
+
+// Collect a running reading once its window has completed
+static inline void MEAS_Check(void) {
+	int16_t average;
+	
+	if (MEAS_STATE != MEAS_RUNNING) { return; }
+	average = ADC_Read_RF();
+	if (average < 0) { return; }
+	MEAS_RESULT = average;
+	MEAS_STATE = MEAS_DONE;
+}
+
+// Answer a waiting query, always in dBm without units
+static inline void MEAS_Print(void) {
+	PRINT_Line_Start();
+	PRINT_Fixed(RF_Counts_To_cdBm(MEAS_RESULT), 2);
+	PRINT_Line_End();
+	MEAS_QUERY = 0;
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -392,44 +1051,1084 @@ static inline void Set_LED(int8_t state) {
 // ~~ ADC Functions
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-// Read RF Power Value
-static inline int16_t ADC_Read_RF(void) {
-	ADMUX = 0b00000000;
-	ADCSRB = 0b00000000;
-	ADCSRA |= (1<<ADSC); // Start first conversion (throw away)
-	while (ADCSRA & (1<<ADSC)); // Wait for conversion to complete
-	ADCSRA |= (1<<ADSC); // Start second conversion (valid)
-	while (ADCSRA & (1<<ADSC)); // Wait for conversion to complete
-	return ADCW;
+// Start conversions of the RF input, timed by timer 0 unless ADC_SLEEP or ADC_TIMER_HZ 0
+// select sleep or free-running conversions. Samples are collected by ADC_vect.
+// Also used to restart acquisition after the sample resolution (ADC_OVERSAMPLE) changes.
+static inline void ADC_Start_RF(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		SAMPLES_HEAD = 0;
+		SAMPLES_TAIL = 0;
+		SAMPLES_GAP = 0;
+	}
+	SAMPLES_INDEX = 0;
+	ADC_Filter_Reset();
+	ADC_Stats_Reset();
+	HIST_Reset(); // Bins depend on the oversampling
+	if (FIT_LEFT > 0) { FIT_Restart(); } // So does a reference level sum
+	
+	ADC_Trigger_Start();
 }
 
-// Load RF Calibration Values
-static inline void Load_RF_Calibration(uint16_t freq) {
-	// Convert freq in MHz to the span number
-	uint8_t RF_FREQ_SPAN = (int)(freq / 100);
+// Set up what starts each conversion, without touching the samples collected so far.
+// A capture records free-running, the fastest the ADC goes, whatever the other settings.
+static inline void ADC_Trigger_Start(void) {
+	ADMUX = 0b00000000; // External AREF, ADC0
+	ADCSRA = (1<<ADIF); // Stop conversions while the trigger source changes, dropping any waiting result
+	ADC_Timer_Stop();
+	ADC_DISCARD = 1; // The first conversion after enabling the ADC takes 25 clocks, and may follow a mux change
+	ADC_OS_SUM = 0; // Don't mix conversions from either side of the change into one sample
+	ADC_OS_COUNT = 1 << (2 * ADC_OVERSAMPLE);
+	if (CAPTURE_STATE >= CAPTURE_ARMED) {
+		ADCSRB = 0b00000000; // Free running mode
+		ADCSRA = (1<<ADEN) | (1<<ADSC) | (1<<ADATE) | (1<<ADIE) | ADC_PRESCALER;
+	} else if (ADC_SLEEP) {
+		// Single conversions, started by entering sleep in ADC_Sleep_Convert()
+		ADCSRB = 0b00000000;
+		ADCSRA = (1<<ADEN) | (1<<ADIE) | ADC_PRESCALER;
+	} else if (ADC_TIMER_HZ > 0) {
+		// Conversions started by timer 0 compare match A
+		ADCSRB = (1<<ADTS1) | (1<<ADTS0);
+		ADCSRA = (1<<ADEN) | (1<<ADATE) | (1<<ADIE) | ADC_PRESCALER;
+		ADC_Timer_Start();
+	} else {
+		ADCSRB = 0b00000000; // Free running mode
+		ADCSRA = (1<<ADEN) | (1<<ADSC) | (1<<ADATE) | (1<<ADIE) | ADC_PRESCALER;
+	}
+}
+
+// Run timer 0 in CTC mode at ADC_TIMER_HZ, using the smallest prescaler that fits the
+// period in 8 bits. Each compare match starts one conversion.
+static inline void ADC_Timer_Start(void) {
+	for (uint8_t i = 0; i < sizeof(ADC_TIMER_SHIFTS); i++) {
+		uint32_t clock = F_CPU >> pgm_read_byte(&ADC_TIMER_SHIFTS[i]);
+		uint32_t period = (clock + ADC_TIMER_HZ / 2) / ADC_TIMER_HZ;
+		
+		if (period <= 256) {
+			TCNT0 = 0;
+			OCR0A = period - 1;
+			TIFR0 = (1<<OCF0A);
+			TCCR0A = (1<<WGM01); // CTC, no pin changes on compare match
+			TIMSK0 = (1<<OCIE0A); // Only to clear the flag, see TIMER0_COMPA_vect
+			TCCR0B = i + 1; // Clock select, starts the timer
+			ADC_TIMER_CHZ = (clock * 100 + period / 2) / period;
+			return;
+		}
+	}
+}
+
+// Stop timer 0, which stops timed conversions
+static inline void ADC_Timer_Stop(void) {
+	TCCR0B = 0;
+	TCCR0A = 0;
+	TIMSK0 = 0;
+	ADC_TIMER_CHZ = 0;
+}
+
+// Sleep in ADC Noise Reduction mode, which halts the CPU and I/O clocks and starts a
+// conversion. ADC_vect wakes us once the sample is taken.
+static inline void ADC_Sleep_Convert(void) {
+	set_sleep_mode(SLEEP_MODE_ADC);
 	
-	// If the result ends up out of the valid range, default and print a message
-	if (RF_FREQ_SPAN < 0 || RF_FREQ_SPAN > 26) {
-		RF_FREQ_SPAN = 0;
-		printPGMStr(STR_Freq_Range);
+	cli();
+	if (ADCSRA & (1<<ADSC)) {
+		// Still converting after an early wake up, let it finish awake
+		sei();
+		return;
 	}
+	ADC_CONVERTED = 0;
+	sleep_enable();
+	sei(); // Executes the next instruction before any interrupt, so we can't miss the wake up
+	sleep_cpu();
+	sleep_disable();
+	
+	// Woken early by USB or the timer, the conversion carries on awake. How long timer 1
+	// stood still isn't known, so leave it rather than push the tick ahead.
+	if (!ADC_CONVERTED) { return; }
 	
-	// Load calibration data corresponding to the selected span
-	RF_FREQ_SLOPE = EEPROM_Read_RF_Cal_Slope(RF_FREQ_SPAN);
-	RF_FREQ_INTERCEPT = EEPROM_Read_RF_Cal_Intercept(RF_FREQ_SPAN);
+	// Timer 1 stood still during the conversion, catch it up. Writing TCNT1 blocks a compare
+	// match on the next timer clock, so stop short of OCR1A rather than skip a tick.
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint16_t count = TCNT1 + ADC_SLEEP_TIMER_COMP;
+		TCNT1 = (count < OCR1A - 1) ? count : OCR1A - 2;
+	}
 }
 
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Consume all buffered samples, running them through the filter stage, tracking the
+// interval statistics and histogram, and counting them towards sample based reports.
+static inline void ADC_Process(void) {
+	const uint16_t * span;
+	uint8_t count;
+	// Leave the histogram alone while it is being sent
+	uint8_t hist_hold = BLOCK_Busy() && BLOCK_HEADER.Type == BLOCK_TYPE_HIST;
+	uint8_t stats = REPORT_MODE != REPORT_OFF && STREAM_MODE == STREAM_OFF;
+	
+	// At most two spans, before and after the buffer wraps
+	while ((count = SAMPLES_Peek(&span)) > 0) {
+		for (uint8_t i = 0; i < count; i++) {
+			uint16_t sample = span[i];
+			
+			// Samples dropped by ADC_vect still advance the index, and a stream frame
+			// never spans the gap so its Tick stays exact
+			if (sample & SAMPLES_GAP_FLAG) {
+				SAMPLES_INDEX += sample & SAMPLES_GAP_MAX;
+				if (STREAM_MODE != STREAM_OFF) { STREAM_Gap(); }
+				continue;
+			}
+			
+			if (STREAM_MODE != STREAM_OFF) { STREAM_Sample(sample); }
+			
+			// Only while a report will collect them, otherwise the sum would wrap
+			if (stats) {
+				if (sample < RF_STAT_MIN) { RF_STAT_MIN = sample; }
+				if (sample > RF_STAT_MAX) { RF_STAT_MAX = sample; }
+				RF_STAT_SUM += sample;
+				RF_STAT_COUNT++;
+			}
+			
+			if (!hist_hold) { HIST_Add(sample); }
+			
+			if (FIT_LEFT > 0) { FIT_Sample(sample); }
+			
+			ADC_Filter(sample);
+			SAMPLES_INDEX++;
+			
+			if (REPORT_MODE == REPORT_SAMPLES && ++REPORT_SAMPLE_COUNT >= REPORT_EVERY) {
+				REPORT_SAMPLE_COUNT = 0;
+				schedule_read_rf = 1;
+			}
+		}
+		SAMPLES_Consume(count);
+	}
+}
+
+// Read RF Power Value
+// Returns the latest complete window average, or -1 if none is complete yet.
+// With AVG_WINDOW 0 the window is everything collected since the previous read.
+// The other filters return their latest output.
+static inline int16_t ADC_Read_RF(void) {
+	if (FILTER_MODE != FILTER_MEAN) { return FILTER_READY ? (int16_t)FILTER_OUT : -1; }
+	
+	if (AVG_WINDOW == 0 && RF_AVG_COUNT > 0) {
+		RF_AVG_LAST_SUM = RF_AVG_SUM;
+		RF_AVG_LAST_COUNT = RF_AVG_COUNT;
+		RF_AVG_SUM = 0;
+		RF_AVG_COUNT = 0;
+	}
+	
+	if (RF_AVG_LAST_COUNT == 0) { return -1; }
+	return RF_AVG_LAST_SUM / RF_AVG_LAST_COUNT;
+}
+
+// Run one sample through the selected filter
+static inline void ADC_Filter(uint16_t sample) {
+	switch (FILTER_MODE) {
+		case FILTER_MEAN:
+			RF_AVG_SUM += sample;
+			if (++RF_AVG_COUNT == AVG_WINDOW || RF_AVG_COUNT == ADC_AVG_MAX) {
+				RF_AVG_LAST_SUM = RF_AVG_SUM;
+				RF_AVG_LAST_COUNT = RF_AVG_COUNT;
+				RF_AVG_SUM = 0;
+				RF_AVG_COUNT = 0;
+			}
+			break;
+		
+		case FILTER_EMA:
+			// FILTER_ACC holds the average scaled by 2^shift, start it at the first sample.
+			// Decay before adding: a steady input x then holds FILTER_ACC at x * 2^shift
+			// (x * 2^shift - x + x), so the output is x at every shift. Adding first would
+			// settle at x * (2^shift - 1), reading low by x * 2^-shift.
+			if (FILTER_COUNT == 0) {
+				FILTER_ACC = (uint32_t)sample << FILTER_SHIFT;
+			} else {
+				FILTER_ACC -= FILTER_ACC >> FILTER_SHIFT;
+				FILTER_ACC += sample;
+			}
+			FILTER_OUT = FILTER_ACC >> FILTER_SHIFT;
+			// Seeded from one sample, so wait out one time constant (2^shift samples)
+			if (FILTER_COUNT < (1U << FILTER_SHIFT)) { FILTER_COUNT++; }
+			if (FILTER_COUNT == (1U << FILTER_SHIFT)) { FILTER_READY = 1; }
+			break;
+		
+		case FILTER_BOXCAR:
+			FILTER_ACC += sample;
+			FILTER_ACC -= FILTER_RING[FILTER_POS];
+			FILTER_RING[FILTER_POS] = sample;
+			FILTER_POS = (FILTER_POS + 1) & ((1 << FILTER_SHIFT) - 1);
+			// Wait for the history to fill
+			if (FILTER_COUNT < (1 << FILTER_SHIFT)) { FILTER_COUNT++; }
+			if (FILTER_COUNT == (1 << FILTER_SHIFT)) {
+				FILTER_OUT = FILTER_ACC >> FILTER_SHIFT;
+				FILTER_READY = 1;
+			}
+			break;
+		
+		case FILTER_CIC:
+			// Integrators at the sample rate, modulo 2^32
+			FILTER_INT[0] += sample;
+			for (uint8_t i = 1; i < FILTER_CIC_ORDER; i++) { FILTER_INT[i] += FILTER_INT[i - 1]; }
+			
+			// Combs at the decimated rate, the differences come out exact despite the wrapping
+			if (++FILTER_POS >= (1 << FILTER_SHIFT)) {
+				uint32_t value = FILTER_INT[FILTER_CIC_ORDER - 1];
+				
+				FILTER_POS = 0;
+				for (uint8_t i = 0; i < FILTER_CIC_ORDER; i++) {
+					uint32_t delayed = FILTER_COMB[i];
+					FILTER_COMB[i] = value;
+					value -= delayed;
+				}
+				// The first outputs are still filling the combs
+				if (FILTER_COUNT < FILTER_CIC_ORDER) {
+					FILTER_COUNT++;
+				} else {
+					FILTER_OUT = value >> (FILTER_CIC_ORDER * FILTER_SHIFT);
+					FILTER_READY = 1;
+				}
+			}
+			break;
+	}
+}
+
+// Restart the filter stage
+static inline void ADC_Filter_Reset(void) {
+	RF_AVG_SUM = 0;
+	RF_AVG_COUNT = 0;
+	RF_AVG_LAST_COUNT = 0;
+	FILTER_ACC = 0;
+	FILTER_POS = 0;
+	FILTER_COUNT = 0;
+	FILTER_READY = 0;
+	memset(FILTER_RING, 0, sizeof(FILTER_RING));
+	memset(FILTER_INT, 0, sizeof(FILTER_INT));
+	memset(FILTER_COMB, 0, sizeof(FILTER_COMB));
+}
+
+// Start a new statistics interval
+static inline void ADC_Stats_Reset(void) {
+	RF_STAT_MIN = UINT16_MAX;
+	RF_STAT_MAX = 0;
+	RF_STAT_SUM = 0;
+	RF_STAT_COUNT = 0;
+}
+
+// Load RF Calibration Values
+// Interpolates between the two spans whose centres bracket freq, and precomputes the
+// fixed point conversion so each reading stays a single multiply-add.
+static inline void Load_RF_Calibration(uint16_t freq) {
+	uint8_t span = 0;
+	uint8_t frac = 0;
+	
+	// Convert freq in MHz to the span number
+	RF_FREQ_SPAN = freq / RF_CAL_SPAN_MHZ;
+	
+	// If the result ends up out of the valid range, default and print a message
+	if (RF_FREQ_SPAN >= RF_CAL_SPANS) {
+		RF_FREQ_SPAN = 0;
+		freq = RF_CAL_SPAN_MHZ / 2;
+		if (!MACHINE_MODE) { printPGMStr(STR_Freq_Range); }
+	}
+	RF_FREQ = freq;
+	
+	// Span below freq, and how far (MHz) freq is past its centre. Flat beyond the end centres.
+	if (freq > RF_CAL_SPAN_MHZ / 2) {
+		span = (freq - RF_CAL_SPAN_MHZ / 2) / RF_CAL_SPAN_MHZ;
+		frac = (freq - RF_CAL_SPAN_MHZ / 2) % RF_CAL_SPAN_MHZ;
+		if (span >= RF_CAL_SPANS - 1) {
+			span = RF_CAL_SPANS - 1;
+			frac = 0;
+		}
+	}
+	
+	// Load calibration data corresponding to the selected spans
+	RF_FREQ_SLOPE = CAL_POINTS[span].Slope;
+	RF_FREQ_INTERCEPT = CAL_POINTS[span].Intercept;
+	if (frac > 0) {
+		int32_t slope_diff = (int32_t)CAL_POINTS[span + 1].Slope - RF_FREQ_SLOPE;
+		int32_t intercept_diff = (int32_t)CAL_POINTS[span + 1].Intercept - RF_FREQ_INTERCEPT;
+		
+		RF_FREQ_SLOPE += (slope_diff * frac + (slope_diff < 0 ? -50 : 50)) / 100;
+		RF_FREQ_INTERCEPT += (intercept_diff * frac + (intercept_diff < 0 ? -50 : 50)) / 100;
+	}
+	
+	// Precompute the fixed point conversion constants
+	RF_CAL_GAIN = (RF_CAL_GAIN_NUM + RF_FREQ_SLOPE / 2) / RF_FREQ_SLOPE;
+	RF_Cal_Offset_Update();
+}
+
+// Recompute the conversion offset from the intercept, less the temperature drift
+static inline void RF_Cal_Offset_Update(void) {
+	int16_t drift = 0;
+	
+	if (TEMP_VALID) {
+		int32_t product = (int32_t)TEMP_CO * (TEMP_NOW - TEMP_REF); // 0.00001 dB
+		drift = (product + (product < 0 ? -500 : 500)) / 1000;
+	}
+	RF_CAL_OFFSET = RF_DETECTOR_OFFSET - RF_FREQ_INTERCEPT - drift;
+}
+
+// Convert an ADC reading into centi-dBm using the loaded calibration.
+// Readings carry ADC_OVERSAMPLE extra bits, which are folded into the shift.
+static inline int16_t RF_Counts_To_cdBm(uint16_t counts) {
+	uint8_t shift = RF_CAL_GAIN_SHIFT + ADC_OVERSAMPLE;
+	uint32_t scaled = (uint32_t)counts * RF_CAL_GAIN + (1UL << (shift - 1));
+	return (int16_t)(scaled >> shift) + RF_CAL_OFFSET;
+}
+
+// Convert a level in centi-dBm into raw (not oversampled) ADC counts using the loaded calibration
+static inline uint16_t RF_cdBm_To_Counts(int16_t cdbm) {
+	int32_t counts = (((int32_t)cdbm - RF_CAL_OFFSET) << RF_CAL_GAIN_SHIFT) / RF_CAL_GAIN;
+	if (counts < 0) { return 0; }
+	if (counts > (1 << ADC_BITS) - 1) { return (1 << ADC_BITS) - 1; }
+	return counts;
+}
+
+// Convert an ADC reading into millivolts referenced on ADC_V_REF_MV
+static inline uint16_t RF_Counts_To_mV(uint16_t counts) {
+	uint8_t shift = ADC_BITS + ADC_OVERSAMPLE;
+	return ((uint32_t)counts * ADC_V_REF_MV + (1UL << (shift - 1))) >> shift;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Schedule Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Switch to timed readings every ticks (ms)
+static inline void Set_Report_Interval(uint32_t ticks) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		REPORT_INTERVAL = ticks;
+		report_countdown = ticks;
+		REPORT_MODE = (ticks > 0) ? REPORT_TIME : REPORT_OFF;
+		schedule_read_rf = 0;
+	}
+	ADC_Stats_Reset(); // The first reading covers the new interval
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Report Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Take a reading and the interval statistics, and queue them for printing.
+// held marks a reading that can't be printed straight away.
+// Returns 0 if there is no complete average to read yet.
+static inline uint8_t REPORT_Take(uint8_t held) {
+	REPORT_Entry_t * entry;
+	int16_t average = ADC_Read_RF();
+	
+	if (average < 0) { return 0; }
+	
+	if (REPORT_QUEUE_COUNT == REPORT_QUEUE_LEN) {
+		// Keep the older readings, so the host sees an unbroken run up to the gap
+		if (REPORT_DROPPED < UINT16_MAX) { REPORT_DROPPED++; }
+		ADC_Stats_Reset();
+		return 1;
+	}
+	
+	entry = &REPORT_QUEUE[(REPORT_QUEUE_HEAD + REPORT_QUEUE_COUNT) % REPORT_QUEUE_LEN];
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		entry->Tick = timer;
+	}
+	entry->Held = held;
+	entry->Average = average;
+	entry->Min = RF_STAT_MIN;
+	entry->Max = RF_STAT_MAX;
+	entry->Mean = (RF_STAT_COUNT > 0) ? (RF_STAT_SUM + RF_STAT_COUNT / 2) / RF_STAT_COUNT : 0;
+	entry->Count = RF_STAT_COUNT;
+	REPORT_QUEUE_COUNT++;
+	
+	ADC_Stats_Reset();
+	return 1;
+}
+
+// Print the oldest queued reading
+static inline void REPORT_Print_Next(void) {
+	const REPORT_Entry_t * entry = &REPORT_QUEUE[REPORT_QUEUE_HEAD];
+	
+	Set_LED(1);
+	
+	// Convert the average reading into a dBm or voltage value
+	PRINT_Line_Start();
+	PRINT_Level(entry->Average);
+	
+	#ifdef FLOAT_REFERENCE
+		// Original floating point conversion, for comparison
+		if (FLOATREF) {
+			float temp = (entry->Average * (ADC_V_REF / (1024.0 * (1 << ADC_OVERSAMPLE))));
+			if (OUTPUTRAW == 0) {
+				temp = (temp / (RF_FREQ_SLOPE / 1000000.0)) - (RF_FREQ_INTERCEPT / 100.0) + 19.95;
+				fprintf_P(&USBSerialStream, PSTR("\t(ref %.4f dBm)"), temp);
+			} else {
+				fprintf_P(&USBSerialStream, PSTR("\t(ref %.4f V)"), temp);
+			}
+		}
+	#endif
+	
+	// Envelope of every sample in the interval
+	if (STATS && entry->Count > 0) {
+		printPGMStr(PSTR("\tmin "));
+		PRINT_Level(entry->Min);
+		printPGMStr(PSTR("\tmax "));
+		PRINT_Level(entry->Max);
+		printPGMStr(PSTR("\tmean "));
+		PRINT_Level(entry->Mean);
+		fprintf_P(&USBSerialStream, PSTR("\tn %lu"), (unsigned long)entry->Count);
+	}
+	
+	// Say how long a reading waited for the line
+	if (entry->Held) {
+		unsigned long now;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			now = timer;
+		}
+		fprintf_P(&USBSerialStream, PSTR("\t(delayed %lu ms)"), now - entry->Tick);
+	}
+	PRINT_Line_End();
+	
+	REPORT_QUEUE_HEAD = (REPORT_QUEUE_HEAD + 1) % REPORT_QUEUE_LEN;
+	REPORT_QUEUE_COUNT--;
+	
+	Set_LED(0);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Streaming Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Switch streaming mode, starting a fresh frame
+static inline void STREAM_Start(uint8_t mode) {
+	STREAM_MODE = mode;
+	ADC_Stats_Reset(); // Nothing was collected while streaming
+	STREAM_FRAME.Sync = STREAM_SYNC;
+	STREAM_FRAME.Sequence = 0;
+	STREAM_FRAME_POS = 0;
+}
+
+// Add a sample to the current frame, sending it once it is full
+static inline void STREAM_Sample(uint16_t sample) {
+	if (STREAM_FRAME_POS == 0) {
+		// Timed samples are numbered instead, their time is the index times the sample period
+		if (ADC_TIMER_CHZ > 0) {
+			STREAM_FRAME.Tick = SAMPLES_INDEX;
+		} else {
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				STREAM_FRAME.Tick = timer;
+			}
+		}
+		STREAM_FRAME.Span = RF_FREQ_SPAN;
+		STREAM_FRAME.Flags = (STREAM_MODE == STREAM_CDBM) ? STREAM_FLAG_CDBM : (ADC_OVERSAMPLE << STREAM_FLAG_OVERSAMPLE_SHIFT);
+		if (ADC_TIMER_CHZ > 0) { STREAM_FRAME.Flags |= STREAM_FLAG_TIMED; }
+	}
+	
+	if (STREAM_MODE == STREAM_CDBM) {
+		STREAM_FRAME.Samples[STREAM_FRAME_POS] = RF_Counts_To_cdBm(sample);
+	} else {
+		STREAM_FRAME.Samples[STREAM_FRAME_POS] = sample;
+	}
+	
+	if (++STREAM_FRAME_POS >= STREAM_FRAME_SAMPLES) {
+		// Only queue whole frames, if the host isn't keeping up skip this one
+		if (!BLOCK_Busy() && CDC_Device_TxQueueFree(&VirtualSerial_CDC_Interface) >= sizeof(STREAM_FRAME)) {
+			CDC_Device_SendData(&VirtualSerial_CDC_Interface, &STREAM_FRAME, sizeof(STREAM_FRAME));
+			USB_Flush(); // A frame is a whole packet, the host waits for the zero length one after it
+		} else if (STREAM_DROPPED < 0xFFFF) {
+			STREAM_DROPPED++;
+		}
+		STREAM_FRAME.Sequence++;
+		STREAM_FRAME_POS = 0;
+	}
+}
+
+// Abandon a partly filled frame after samples were dropped, counting it as skipped
+static inline void STREAM_Gap(void) {
+	if (STREAM_FRAME_POS == 0) { return; }
+	if (STREAM_DROPPED < 0xFFFF) { STREAM_DROPPED++; }
+	STREAM_FRAME.Sequence++;
+	STREAM_FRAME_POS = 0;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Capture Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Record raw conversions into CAPTURE_BUFF, straight from ADC_vect.
+// A threshold of INT16_MIN starts recording the post samples immediately. Otherwise the
+// buffer runs circularly, keeping the last pre samples, until the first conversion at or
+// above threshold (cdBm) after the input has been below it. The triggering conversion is
+// the first of the post samples.
+static inline void CAPTURE_Start(uint8_t pre, uint16_t post, int16_t threshold) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		CAPTURE_POS = 0;
+		CAPTURE_LEN = pre + post;
+		CAPTURE_PRE = pre;
+		CAPTURE_SEEN = 0;
+		CAPTURE_REMAINING = post;
+		if (threshold == INT16_MIN) {
+			CAPTURE_STATE = CAPTURE_RUNNING;
+		} else {
+			CAPTURE_THRESHOLD = RF_cdBm_To_Counts(threshold);
+			CAPTURE_STATE = CAPTURE_ARMED;
+		}
+		ADC_Trigger_Start(); // Free-running until it is done
+	}
+}
+
+// Handle one raw conversion while a capture is in progress. Only called from ADC_vect.
+static inline void CAPTURE_Sample(uint16_t sample) {
+	uint8_t state = CAPTURE_STATE;
+	
+	if (state == CAPTURE_ARMED) {
+		if (sample < CAPTURE_THRESHOLD) { CAPTURE_STATE = CAPTURE_TRIGGER; }
+	} else if (state == CAPTURE_TRIGGER && sample >= CAPTURE_THRESHOLD) {
+		CAPTURE_STATE = state = CAPTURE_RUNNING;
+	}
+	
+	if (state != CAPTURE_RUNNING) {
+		// Still waiting for the trigger, keep the samples leading up to it
+		if (CAPTURE_PRE == 0) { return; }
+		if (CAPTURE_SEEN < CAPTURE_PRE) { CAPTURE_SEEN++; }
+	} else if (--CAPTURE_REMAINING == 0) {
+		CAPTURE_STATE = CAPTURE_DONE;
+		// Stop free-running, CAPTURE_Send() restores the normal trigger. The conversion
+		// already started is thrown away.
+		ADCSRA &= ~(1<<ADATE);
+		ADC_DISCARD = 1;
+	}
+	
+	CAPTURE_BUFF[CAPTURE_POS] = sample;
+	if (++CAPTURE_POS >= CAPTURE_LEN) { CAPTURE_POS = 0; }
+}
+
+// Reverse CAPTURE_BUFF[start] to CAPTURE_BUFF[end - 1] in place
+static inline void CAPTURE_Reverse(uint16_t start, uint16_t end) {
+	while (start + 1 < end) {
+		uint16_t temp = CAPTURE_BUFF[start];
+		CAPTURE_BUFF[start++] = CAPTURE_BUFF[--end];
+		CAPTURE_BUFF[end] = temp;
+	}
+}
+
+// Send the completed capture as a single binary block, oldest sample first.
+// Param is the trigger position, ie. the number of pre-trigger samples.
+// Input is held off until the block is sent, so a new capture can't overwrite it.
+static inline void CAPTURE_Send(void) {
+	uint16_t window = CAPTURE_SEEN + (CAPTURE_LEN - CAPTURE_PRE);
+	uint16_t start = (CAPTURE_POS + CAPTURE_LEN - window) % CAPTURE_LEN;
+	
+	// Rotate the circular buffer so the window starts at the beginning
+	if (start != 0) {
+		CAPTURE_Reverse(0, start);
+		CAPTURE_Reverse(start, CAPTURE_LEN);
+		CAPTURE_Reverse(0, CAPTURE_LEN);
+	}
+	
+	BLOCK_Start(CAPTURE_PRE ? BLOCK_TYPE_TRIGGER : BLOCK_TYPE_BURST, CAPTURE_SEEN, CAPTURE_BUFF, window * sizeof(CAPTURE_BUFF[0]));
+	CAPTURE_STATE = CAPTURE_IDLE;
+	ADC_Trigger_Start();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Temperature Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Read the temperature coefficient and calibration temperature from EEPROM
+static inline void TEMP_Load(void) {
+	TEMP_CO = eeprom_read_word((const uint16_t*)(EEPROM_OFFSET_TEMP_CO));
+	TEMP_REF = eeprom_read_word((const uint16_t*)(EEPROM_OFFSET_TEMP_REF));
+	// If the values seem out of range, don't correct
+	if (TEMP_CO < TEMP_CO_MIN || TEMP_CO > TEMP_CO_MAX) TEMP_CO = 0;
+	if (TEMP_REF < TEMP_MIN || TEMP_REF > TEMP_MAX) TEMP_REF = TEMP_REF_DEFAULT;
+}
+
+// Write the temperature coefficient and calibration temperature to EEPROM
+static inline void TEMP_Save(void) {
+	eeprom_update_word((uint16_t*)(EEPROM_OFFSET_TEMP_CO), TEMP_CO);
+	eeprom_update_word((uint16_t*)(EEPROM_OFFSET_TEMP_REF), TEMP_REF);
+}
+
+// Filter in a temperature supplied by the host, and correct the readings for it
+static inline void TEMP_Set(int16_t temp) {
+	if (TEMP_VALID) {
+		TEMP_NOW += (temp - TEMP_NOW) / (1 << TEMP_FILTER_SHIFT);
+	} else {
+		TEMP_NOW = temp;
+		TEMP_VALID = 1;
+	}
+	RF_Cal_Offset_Update();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Calibration Fit Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Whether a calibration session holds its sums in the capture buffer
+static inline uint8_t FIT_Holding(void) {
+	return FIT_COUNT > 0 || FIT_LEFT > 0;
+}
+
+// Start averaging the detector output with a reference level (cdBm) applied at the
+// span's centre frequency. The first point of a session claims the capture buffer.
+static inline void FIT_Start(uint8_t span, int16_t level) {
+	if (!FIT_Holding()) { memset(FIT_SPANS, 0, sizeof(FIT_Span_t) * RF_CAL_SPANS); }
+	FIT_SPAN = span;
+	FIT_LEVEL = level;
+	FIT_Restart();
+}
+
+// Sum the reference level being measured from scratch, as when the samples change meaning
+static inline void FIT_Restart(void) {
+	FIT_SUM = 0;
+	FIT_LEFT = 1 << FIT_SAMPLES_SHIFT;
+}
+
+// Sum one sample into the reference level being measured, adding the point to its
+// span's sums once done
+static inline void FIT_Sample(uint16_t sample) {
+	FIT_SUM += sample;
+	if (--FIT_LEFT > 0) { return; }
+	
+	// Mean in uV
+	uint8_t shift = FIT_SAMPLES_SHIFT + ADC_BITS + ADC_OVERSAMPLE;
+	FIT_VOLTAGE = (((uint64_t)FIT_SUM * ADC_V_REF_MV * 1000) + (1UL << (shift - 1))) >> shift;
+	
+	FIT_Span_t * sums = &FIT_SPANS[FIT_SPAN];
+	uint32_t x = FIT_LEVEL - FIT_LEVEL_MIN;
+	uint32_t y = (FIT_VOLTAGE + FIT_VOLTAGE_STEP / 2) / FIT_VOLTAGE_STEP;
+	sums->Count++;
+	sums->SumX += x;
+	sums->SumY += y;
+	sums->SumXX += x * x;
+	sums->SumXY += x * y;
+	FIT_COUNT++;
+	
+	// Unasked for output would break machine mode's one response per command
+	if (!MACHINE_MODE) {
+		fprintf_P(&USBSerialStream, PSTR("\r\nPoint %u, span %u: "), sums->Count, FIT_SPAN);
+		PRINT_Fixed(FIT_VOLTAGE, 6);
+		printPGMStr(PSTR(" V at "));
+		PRINT_Fixed(FIT_LEVEL, 2);
+		printPGMStr(PSTR(" dBm"));
+		USB_Flush();
+	}
+}
+
+// Divide, rounding to nearest. den must be positive.
+static inline int32_t FIT_Div_Round(int64_t num, int64_t den) {
+	return ((num >= 0) ? (num + den / 2) : (num - den / 2)) / den;
+}
+
+// Least squares fit of detector voltage against level for every span with measured
+// points, saving each good fit to the calibration table:
+//   uV = slope (uV/dB) * (level (cdB) + intercept (cdB) - RF_DETECTOR_OFFSET) / 100
+static inline void FIT_Spans(void) {
+	uint8_t saved = 0;
+	
+	// Nothing summed, nor a buffer to read them from
+	if (FIT_COUNT == 0) { return; }
+	
+	for (uint8_t span = 0; span < RF_CAL_SPANS; span++) {
+		const FIT_Span_t * sums = &FIT_SPANS[span];
+		int64_t n = sums->Count;
+		int64_t sx, sy, dxx, dxy;
+		int32_t slope = 0, intercept = 0;
+		
+		if (n == 0) { continue; }
+		
+		// Needs at least two distinct levels. The differences don't depend on the x offset.
+		dxx = n * sums->SumXX - (int64_t)sums->SumX * sums->SumX;
+		dxy = n * sums->SumXY - (int64_t)sums->SumX * sums->SumY;
+		sx = sums->SumX + n * FIT_LEVEL_MIN; // cdBm
+		sy = (int64_t)sums->SumY * FIT_VOLTAGE_STEP; // uV
+		if (dxx > 0) {
+			slope = FIT_Div_Round(100 * FIT_VOLTAGE_STEP * dxy, dxx);
+			if (slope > 0) { intercept = RF_DETECTOR_OFFSET + FIT_Div_Round(100 * sy - slope * sx, n * slope); }
+		}
+		
+		PRINT_Line_Start();
+		fprintf_P(&USBSerialStream, PSTR("Span %u: "), span);
+		if (slope < RF_CAL_SLOPE_MIN || slope > RF_CAL_SLOPE_MAX || intercept < RF_CAL_INTERCEPT_MIN || intercept > RF_CAL_INTERCEPT_MAX) {
+			printPGMStr(PSTR("fit failed"));
+			PRINT_Line_End();
+			continue;
+		}
+		PRINT_Fixed(slope, 6);
+		printPGMStr(PSTR(" - "));
+		PRINT_Fixed(intercept, 2);
+		PRINT_Line_End();
+		CAL_POINTS[span].Slope = slope;
+		CAL_POINTS[span].Intercept = intercept;
+		saved++;
+	}
+	
+	// Commit every span in one pass
+	if (saved > 0) {
+		EEPROM_Cal_Save();
+		Load_RF_Calibration(RF_FREQ);
+		if (!MACHINE_MODE) { printPGMStr(STR_Cal_Saved); }
+	}
+	FIT_COUNT = 0;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Histogram Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Count one sample into its bin
+static inline void HIST_Add(uint16_t sample) {
+	uint16_t * bin = &HIST_BINS[sample >> (HIST_BIN_SHIFT + ADC_OVERSAMPLE)];
+	
+	if (*bin == UINT16_MAX) {
+		// Halve every bin rather than saturate one, so the shape of the distribution is kept
+		for (uint16_t i = 0; i < HIST_BINS_LEN; i++) { HIST_BINS[i] >>= 1; }
+		if (HIST_SHIFT < UINT8_MAX) { HIST_SHIFT++; }
+	}
+	(*bin)++;
+}
+
+// Clear the histogram
+static inline void HIST_Reset(void) {
+	memset(HIST_BINS, 0, sizeof(HIST_BINS));
+	HIST_SHIFT = 0;
+}
+
+// Power at the centre of a bin in centi-dBm
+static inline int16_t HIST_Bin_cdBm(uint16_t bin) {
+	uint8_t shift = HIST_BIN_SHIFT + ADC_OVERSAMPLE;
+	return RF_Counts_To_cdBm((bin << shift) + (1 << (shift - 1)));
+}
+
+// Linear power of a level below centi-dB under the reference, in Q15
+static inline uint16_t HIST_Rel_Power(uint16_t below) {
+	uint16_t steps = (below + 12) / 25; // 0.25 dB
+	uint16_t power;
+	
+	if (steps >= 5 * 40) { return 0; } // Under 50 dB down doesn't register in Q15
+	power = pgm_read_word(&HIST_POWER_TABLE[steps % 40]);
+	for (steps /= 40; steps > 0; steps--) { power /= 10; }
+	return power;
+}
+
+// Find the power of the highest occupied bin, and its ratio in centi-dB to the mean
+// power of every sample binned. Returns the number of samples, 0 if the histogram is empty.
+static inline uint32_t HIST_PAPR(int16_t * peak, uint16_t * papr) {
+	uint32_t total = 0;
+	uint32_t sum = 0; // Samples times their Q15 power relative to the peak, over 256
+	uint32_t mean;
+	uint16_t below = 0;
+	uint8_t step = 0;
+	
+	for (uint16_t i = HIST_BINS_LEN; i-- > 0;) {
+		if (HIST_BINS[i] == 0) { continue; }
+		
+		int16_t level = HIST_Bin_cdBm(i);
+		if (total == 0) { *peak = level; }
+		total += HIST_BINS[i];
+		sum += ((uint32_t)HIST_BINS[i] * HIST_Rel_Power(*peak - level)) >> 8;
+	}
+	if (total == 0) { return 0; }
+	
+	// Mean relative power in Q15, divided in two steps to stay within 32 bits
+	mean = ((sum / total) << 8) + (((sum % total) << 8) / total);
+	
+	// Back to dB, a decade then a 0.25 dB step at a time
+	while (mean < HIST_DECADE && below < 9000) {
+		mean *= 10;
+		below += 1000;
+	}
+	while (step < 39 && pgm_read_word(&HIST_POWER_TABLE[step + 1]) >= mean) { step++; }
+	*papr = below + step * 25;
+	
+	return total;
+}
+
+// Print the peak to average power ratio
+// Returns 0 if the histogram is empty.
+static inline uint8_t HIST_Print_PAPR(void) {
+	int16_t peak;
+	uint16_t papr;
+	uint32_t total = HIST_PAPR(&peak, &papr);
+	
+	if (total == 0) {
+		if (!MACHINE_MODE) { printPGMStr(STR_Hist_Empty); }
+		return 0;
+	}
+	
+	PRINT_Line_Start();
+	printPGMStr(PSTR("PAPR "));
+	PRINT_Fixed(papr, 2);
+	printPGMStr(PSTR(" dB\tpeak "));
+	PRINT_Fixed(peak, 2);
+	printPGMStr(PSTR(" dBm\tmean "));
+	PRINT_Fixed(peak - papr, 2);
+	fprintf_P(&USBSerialStream, PSTR(" dBm\tn %lu"), (unsigned long)total);
+	PRINT_Line_End();
+	return 1;
+}
+
+// Print the CCDF, the share of samples above the mean power by each whole dB
+// Returns 0 if the histogram is empty.
+static inline uint8_t HIST_Print_CCDF(void) {
+	int16_t peak;
+	uint16_t papr;
+	uint32_t total = HIST_PAPR(&peak, &papr);
+	uint32_t above = total; // Samples more than the current row above the mean
+	int16_t mean;
+	uint16_t bin = 0;
+	uint8_t shift = 0;
+	
+	if (total == 0) {
+		if (!MACHINE_MODE) { printPGMStr(STR_Hist_Empty); }
+		return 0;
+	}
+	mean = peak - (int16_t)papr;
+	
+	// Keep count * 10000 within 32 bits
+	while ((total >> shift) > 400000UL) { shift++; }
+	
+	// The bins rise in power, so a single pass up through them takes off the samples
+	// each row leaves behind. No per dB table is needed.
+	PRINT_Line_Start();
+	printPGMStr(PSTR("dB above mean\t% of samples"));
+	for (uint8_t db = 0; db <= HIST_CCDF_MAX; db++) {
+		while (bin < HIST_BINS_LEN && HIST_Bin_cdBm(bin) - mean <= (int16_t)db * 100) {
+			above -= HIST_BINS[bin++];
+		}
+		fprintf_P(&USBSerialStream, PSTR("\r\n%u\t"), db);
+		PRINT_Fixed(((above >> shift) * 10000) / (total >> shift), 2);
+		if (above == 0) { break; }
+	}
+	PRINT_Line_End();
+	return 1;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Binary Block Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Begin sending a binary block. The data must stay untouched until BLOCK_Busy() clears.
+static inline void BLOCK_Start(uint8_t type, uint16_t param, const void * data, uint16_t length) {
+	BLOCK_HEADER.Sync = BLOCK_SYNC;
+	BLOCK_HEADER.Type = type;
+	BLOCK_HEADER.Span = RF_FREQ_SPAN;
+	BLOCK_HEADER.Param = param;
+	BLOCK_HEADER.Length = length;
+	BLOCK_DATA = data;
+	BLOCK_POS = 0;
+	BLOCK_TOTAL = sizeof(BLOCK_HEADER) + length + sizeof(BLOCK_CRC);
+	BLOCK_CRC = 0;
+}
+
+// Is a block still being sent
+static inline uint8_t BLOCK_Busy(void) {
+	return BLOCK_POS < BLOCK_TOTAL;
+}
+
+// Queue as much of the block as the CDC transmit queue has room for, without waiting
+static inline void BLOCK_Continue(void) {
+	uint16_t data_end = sizeof(BLOCK_HEADER) + BLOCK_HEADER.Length;
+	uint8_t free = CDC_Device_TxQueueFree(&VirtualSerial_CDC_Interface);
+	
+	while (free-- && BLOCK_Busy()) {
+		uint8_t byte;
+		
+		if (BLOCK_POS < sizeof(BLOCK_HEADER)) {
+			byte = ((const uint8_t *)&BLOCK_HEADER)[BLOCK_POS];
+		} else if (BLOCK_POS < data_end) {
+			byte = BLOCK_DATA[BLOCK_POS - sizeof(BLOCK_HEADER)];
+		} else if (BLOCK_POS == data_end) {
+			byte = BLOCK_CRC & 0xFF;
+		} else {
+			byte = BLOCK_CRC >> 8;
+		}
+		
+		if (BLOCK_POS < data_end) { BLOCK_CRC = _crc_xmodem_update(BLOCK_CRC, byte); }
+		CDC_Device_SendByte(&VirtualSerial_CDC_Interface, byte);
+		BLOCK_POS++;
+	}
+	
+	if (!BLOCK_Busy()) { USB_Flush(); }
+}
+
+// Start receiving a block of the given type, of at most max payload bytes, into buff.
+// Input bypasses the line editor until the block is complete, fails, or times out.
+static inline void BLOCK_Receive_Start(uint8_t type, void * buff, uint16_t max) {
+	BLOCK_RX_TYPE = type;
+	BLOCK_RX_BUFF = buff;
+	BLOCK_RX_MAX = max;
+	BLOCK_RX_POS = 0;
+	BLOCK_RX_CRC = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		BLOCK_RX_LAST = timer;
+	}
+}
+
+// Is a block being received
+static inline uint8_t BLOCK_Receiving(void) {
+	return BLOCK_RX_TYPE != 0;
+}
+
+// Take whatever bytes of the block have arrived, without waiting
+static inline void BLOCK_Receive(void) {
+	uint16_t data_end = sizeof(BLOCK_RX_HEADER) + BLOCK_RX_HEADER.Length;
+	unsigned long now;
+	int16_t byte;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		now = timer;
+	}
+	
+	while ((byte = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface)) >= 0) {
+		BLOCK_RX_LAST = now;
+		
+		// Skip anything ahead of the sync, like the LF of a CR LF after the command
+		if (BLOCK_RX_POS == 0 && byte != (BLOCK_SYNC & 0xFF)) { continue; }
+		
+		if (BLOCK_RX_POS < sizeof(BLOCK_RX_HEADER)) {
+			((uint8_t *)&BLOCK_RX_HEADER)[BLOCK_RX_POS] = byte;
+			if (BLOCK_RX_POS == sizeof(BLOCK_RX_HEADER) - 1) {
+				if (BLOCK_RX_HEADER.Sync != BLOCK_SYNC || BLOCK_RX_HEADER.Type != BLOCK_RX_TYPE || BLOCK_RX_HEADER.Length > BLOCK_RX_MAX) {
+					BLOCK_Receive_Done(0);
+					return;
+				}
+				data_end = sizeof(BLOCK_RX_HEADER) + BLOCK_RX_HEADER.Length;
+			}
+		} else if (BLOCK_RX_POS < data_end) {
+			BLOCK_RX_BUFF[BLOCK_RX_POS - sizeof(BLOCK_RX_HEADER)] = byte;
+		} else if (BLOCK_RX_POS == data_end) {
+			if (byte != (BLOCK_RX_CRC & 0xFF)) {
+				BLOCK_Receive_Done(0);
+				return;
+			}
+		} else {
+			BLOCK_Receive_Done(byte == (BLOCK_RX_CRC >> 8));
+			return;
+		}
+		
+		if (BLOCK_RX_POS < data_end) { BLOCK_RX_CRC = _crc_xmodem_update(BLOCK_RX_CRC, byte); }
+		BLOCK_RX_POS++;
+	}
+	
+	if (now - BLOCK_RX_LAST > BLOCK_RX_TIMEOUT) { BLOCK_Receive_Done(0); }
+}
+
+// Hand a received block on, or report that it failed
+static inline void BLOCK_Receive_Done(uint8_t ok) {
+	uint8_t type = BLOCK_RX_TYPE;
+	
+	BLOCK_RX_TYPE = 0;
+	switch (type) {
+		case BLOCK_TYPE_CAL:
+			if (ok && EEPROM_Cal_Put(&BLOCK_RX_HEADER, (const CAL_Point_t *)BLOCK_RX_BUFF)) {
+				if (MACHINE_MODE) { PRINT_OK(); } else { printPGMStr(STR_Cal_Saved); }
+			} else {
+				if (MACHINE_MODE) { PRINT_Error(ERR_BLOCK); } else { printPGMStr(STR_Cal_Failed); }
+			}
+			break;
+	}
+	INPUT_Clear();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Sample Buffer Functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Add a sample to the buffer. Only called from ADC_vect.
+// If the main loop has fallen behind the sample is dropped and counted. The next sample
+// that fits is preceded by a gap marker carrying the number dropped, so the main loop
+// can keep SAMPLES_INDEX in step with the conversions actually made.
+static inline void SAMPLES_Insert(uint16_t sample) {
+	uint8_t head = SAMPLES_HEAD;
+	uint16_t gap = SAMPLES_GAP;
+	uint8_t used = (uint8_t)(head - SAMPLES_TAIL);
+	
+	// A pending gap needs room for its marker as well as the sample
+	if (used >= SAMPLES_BUFF_LEN || (gap > 0 && used >= SAMPLES_BUFF_LEN - 1)) {
+		if (SAMPLES_OVERFLOW < 255) { SAMPLES_OVERFLOW++; }
+		if (gap < SAMPLES_GAP_MAX) { SAMPLES_GAP = gap + 1; }
+		return;
+	}
+	
+	if (gap > 0) {
+		SAMPLES_BUFF[head & SAMPLES_BUFF_MASK] = SAMPLES_GAP_FLAG | gap;
+		head++;
+		SAMPLES_GAP = 0;
+	}
+	
+	SAMPLES_BUFF[head & SAMPLES_BUFF_MASK] = sample;
+	// Make sure the sample is stored before the main loop can see the new head
+	__asm__ __volatile__ ("" ::: "memory");
+	SAMPLES_HEAD = head + 1;
+}
+
+// Number of samples waiting to be consumed
+static inline uint8_t SAMPLES_Count(void) {
+	return (uint8_t)(SAMPLES_HEAD - SAMPLES_TAIL);
+}
+
+// Point span at the oldest waiting sample and return how many samples follow it
+// contiguously in the buffer. Samples stay in place until SAMPLES_Consume().
+static inline uint8_t SAMPLES_Peek(const uint16_t ** span) {
+	uint8_t tail = SAMPLES_TAIL;
+	uint8_t count = (uint8_t)(SAMPLES_HEAD - tail);
+	uint8_t to_end = SAMPLES_BUFF_LEN - (tail & SAMPLES_BUFF_MASK);
+	
+	// Don't let the compiler read sample data before the head above
+	__asm__ __volatile__ ("" ::: "memory");
+	
+	*span = &SAMPLES_BUFF[tail & SAMPLES_BUFF_MASK];
+	return (count < to_end) ? count : to_end;
+}
+
+// Release samples previously returned by SAMPLES_Peek()
+static inline void SAMPLES_Consume(uint8_t count) {
+	__asm__ __volatile__ ("" ::: "memory");
+	SAMPLES_TAIL += count;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // ~~ USB Functions
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 // Run the LUFA USB tasks (except reading)
 static inline void run_lufa(void) {
 	//CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
+	// Moves queued output (CDC_DEVICE_TX_QUEUE_SIZE) into the endpoint whenever a bank is free.
+	// Class driver autoflush is disabled (NO_CLASS_DRIVER_AUTOFLUSH) so output is sent in
+	// whole packets, partial packets wait for USB_Flush().
 	CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
 	USB_USBTask();
 }
 
+// Text stream output. Waits for room in the transmit queue, so lines aren't cut short when
+// it fills. Binary frames and blocks write to the driver directly, checking the free space
+// first. If the host stops reading for USB_TX_TIMEOUT ticks, text is dropped (and counted
+// in TxDropped) until the queue empties, so a stalled terminal can't stall sampling.
+static int USB_Putchar(char c, FILE * stream) {
+	unsigned long start;
+	unsigned long now;
+	
+	if (USB_DeviceState == DEVICE_STATE_Configured) {
+		if (CDC_Device_TxQueueFree(&VirtualSerial_CDC_Interface) == CDC_DEVICE_TX_QUEUE_SIZE) { USB_TX_STALLED = 0; }
+		
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			start = timer;
+		}
+		while (!USB_TX_STALLED && CDC_Device_TxQueueFree(&VirtualSerial_CDC_Interface) == 0) {
+			run_lufa();
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				now = timer;
+			}
+			if (now - start >= USB_TX_TIMEOUT) { USB_TX_STALLED = 1; }
+		}
+	}
+	
+	return CDC_Device_SendByte(&VirtualSerial_CDC_Interface, c) ? _FDEV_ERR : 0;
+}
+
+// Send a partially filled packet at the end of a reading or command response.
+// Doesn't wait, the packet goes out once the transmit queue has drained.
+static inline void USB_Flush(void) {
+	CDC_Device_Flush(&VirtualSerial_CDC_Interface);
+}
+
 // Event handler for the library USB Connection event.
 void EVENT_USB_Device_Connect(void) {
 	// We're enumerated. Act on that as desired.
@@ -14,9 +14,12 @@
 #include <avr/sleep.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
 
@@ -33,40 +36,290 @@
 // storage of color codes/modified strings.
 #define ENABLECOLORS
 
+// FLOAT_REFERENCE is set from the Makefile (make FLOAT_REFERENCE=1). It keeps the original
+// floating point conversion available through the FLOATREF command, so readings can be
+// compared against the fixed point path. Requires the printf_flt/libm link flags.
+
 #define SOFTWARE_STR "\r\nERD RF Power Meter"
 #define HARDWARE_VERS "1.2"
 #define SOFTWARE_VERS "1.1"
-#define EEPROM_VERS 1
+#define EEPROM_VERS 2
 
 // Serial input
+#define CMD_NAME_LEN 15 // Longest command name
+#define CMD_ARGS_MAX 3
+#define CMD_FLAG_SCPI 0x01 // No OK / ERR line, errors are only queued for SYST:ERR?
+
+// Machine mode error codes, sent as "ERR <code>". Index ERROR_TABLE for the SCPI equivalent.
+#define ERR_NONE 0
+#define ERR_UNKNOWN 1 // No such command
+#define ERR_ARGS 2 // Wrong number of arguments, or not numbers
+#define ERR_RANGE 3 // Argument out of range
+#define ERR_STATE 4 // Can't be done right now
+#define ERR_LENGTH 5 // Line too long
+#define ERR_BLOCK 6 // Binary block rejected
+#define ERR_OVERFLOW 7 // Error queue overflowed
+#define ERROR_QUEUE_LEN 4 // Errors held for SYST:ERR?
 #define DATA_BUFF_LEN 32
 
+// Single readings for SCPI queries
+#define MEAS_IDLE 0
+#define MEAS_RUNNING 1
+#define MEAS_DONE 2
+
 // ADC
-#define ADC_V_REF 1.2
-#define ADC_AVG_POINTS 5
+#define ADC_V_REF_MV 1200
+#define ADC_BITS 10
+#define ADC_OVERSAMPLE_MAX 4 // Extra bits, 4^n conversions are summed and decimated per sample
+#define ADC_AVG_POINTS 5 // Default averaging window
+#define ADC_AVG_MAX 65535 // Largest window, and the most samples averaged per report with AVG0
+
+// Filter stage between the samples and the readings. Samples are at most 14 bits (10 bits
+// plus 4 oversampled), so every accumulator below fits 32 bits at its largest shift.
+#define FILTER_MEAN 0 // Mean of blocks of AVG_WINDOW samples
+#define FILTER_EMA 1 // Exponential moving average, alpha = 2^-shift
+#define FILTER_BOXCAR 2 // Moving average of the last 2^shift samples
+#define FILTER_CIC 3 // CIC decimator, one reading per 2^shift samples
+#define FILTER_EMA_SHIFT_MAX 15
+#define FILTER_BOXCAR_SHIFT_MAX 6
+#define FILTER_BOXCAR_LEN (1 << FILTER_BOXCAR_SHIFT_MAX)
+#define FILTER_CIC_ORDER 3
+#define FILTER_CIC_SHIFT_MAX 6 // Gain of 2^(ORDER * shift)
+#define ADC_PRESCALER ((1<<ADPS2)) // /16, 62.5kHz ADC clock at 1MHz CPU (~4.8k samples/s free-running)
+#define ADC_PRESCALER_DIV 16
+// Timed conversions, timer 0 clock is F_CPU >> ADC_TIMER_SHIFTS[CS0 - 1]
+#define ADC_TIMER_HZ_MIN 4 // F_CPU / 1024 / 256, rounded up
+// Auto-triggered conversions take 13.5 ADC clocks, 216us. The compare match flag that starts
+// them is cleared by entering TIMER0_COMPA_vect, which other interrupts can hold off for about
+// 400 cycles (ADC_vect, TIMER1_COMPA_vect and USB_GEN_vect back to back). The period has to
+// cover both or matches are lost without a trace.
+#define ADC_TIMER_HZ_MAX 1600
+// Default conversion rate. At 1MHz that is 1000 cycles per sample, of which ADC_vect takes
+// about 100 and ADC_Process about 190 with every per-sample feature on. The rest leaves the
+// 64 sample ring 64ms of slack for printing. Free-running (208 cycles) or rates much above
+// this outrun the main loop, which SAMPLES_OVERFLOW counts.
+#define ADC_TIMER_HZ_DEFAULT 1000
+// Timer 1 counts (clock /8) missed while clkIO is halted for one conversion in ADC Noise Reduction sleep
+#define ADC_SLEEP_TIMER_COMP ((13 * ADC_PRESCALER_DIV) / 8)
+
+// Sample buffer between the ADC interrupt and the main loop
+#define SAMPLES_BUFF_LEN 64 // Must be a power of two, no larger than 128
+#define SAMPLES_BUFF_MASK (SAMPLES_BUFF_LEN - 1)
+#define SAMPLES_GAP_FLAG 0x8000 // Marks a buffer entry as a count of dropped samples, real samples never reach bit 15
+#define SAMPLES_GAP_MAX 0x7FFF
+
+// Fixed point calibration
+// centi-dBm = ((counts * RF_CAL_GAIN) >> RF_CAL_GAIN_SHIFT) + RF_CAL_OFFSET
+// RF_CAL_GAIN = RF_CAL_GAIN_NUM / slope (uV/dB), RF_CAL_OFFSET = RF_DETECTOR_OFFSET - intercept (cdB)
+// Each 100MHz span's values hold at its centre, and are interpolated between centres.
+#define RF_CAL_SPANS 27
+#define RF_CAL_SPAN_MHZ 100
+#define RF_CAL_GAIN_SHIFT 12
+#define RF_CAL_GAIN_NUM ((uint32_t)ADC_V_REF_MV * 100000UL * (1UL << (RF_CAL_GAIN_SHIFT - ADC_BITS)))
+#define RF_DETECTOR_OFFSET 1995 // cdB, detector output referenced to its 19.95dB intercept point
+
+#ifdef FLOAT_REFERENCE
+	#define ADC_V_REF (ADC_V_REF_MV / 1000.0)
+#endif
+
+// Binary streaming
+#define STREAM_SYNC 0xA55A // Sent little-endian, 0x5A 0xA5 on the wire
+#define STREAM_FRAME_SAMPLES 27 // 10 byte header + 27 samples = 64 byte frames
+#define STREAM_OFF 0
+#define STREAM_RAW 1 // ADC counts
+#define STREAM_CDBM 2 // Calibrated centi-dBm
+#define STREAM_FLAG_CDBM 0x01
+#define STREAM_FLAG_TIMED 0x02 // Tick is the index of the first sample, taken on the SRATE clock
+#define STREAM_FLAG_OVERSAMPLE_SHIFT 4 // Upper nibble holds the extra oversampled bits of raw samples
+
+// Binary blocks (captures, tables), sent as a BLOCK_Header_t, payload and CRC16
+#define BLOCK_SYNC 0xA5C3 // Sent little-endian, 0xC3 0xA5 on the wire
+#define BLOCK_TYPE_BURST 'B' // Raw conversions at CAPTURE_HZ
+#define BLOCK_TYPE_TRIGGER 'T' // Likewise, Param is the number before the trigger
+#define BLOCK_TYPE_HIST 'H'
+#define BLOCK_TYPE_CAL 'C' // Both ways, Param is the point count
+#define BLOCK_RX_TIMEOUT 1000 // Ticks without a byte before an upload is abandoned
+
+// Burst capture
+#define CAPTURE_BUFF_LEN 256 // Samples
+#define CAPTURE_HZ (F_CPU / ADC_PRESCALER_DIV / 13) // Free-running, 13 ADC clocks per conversion (4807 Hz at 1MHz)
+#define CAPTURE_IDLE 0
+#define CAPTURE_DONE 1 // Buffer full, waiting to be sent
+#define CAPTURE_ARMED 2 // Waiting for the input to drop below the threshold, keeping pre-trigger samples
+#define CAPTURE_TRIGGER 3 // Waiting for the input to rise through the threshold, keeping pre-trigger samples
+#define CAPTURE_RUNNING 4 // Recording post-trigger samples
+
+// Calibration fit
+#define FIT_SPAN_POINTS_MAX 16 // Reference levels summed per span until CALFIT, keeps the sums within 32 bits
+#define FIT_VOLTAGE_STEP 100 // uV, detector voltages are summed in 0.1 mV steps
+#define FIT_SAMPLES_SHIFT 12 // 4096 samples averaged per reference level
+#define FIT_LEVEL_MIN -6000 // cdBm
+#define FIT_LEVEL_MAX 2000
+
+// Power histogram
+#define HIST_BINS_LEN 128
+#define HIST_BIN_SHIFT 3 // 8 ADC counts per bin, about 0.54 dB at the nominal 17.3 mV/dB slope
+#define HIST_DECADE 3277 // 0.1 in the Q15 relative power table
+#define HIST_CCDF_MAX 30 // dB above the mean
 
 // Pins
 #define RF_ANALOG PF0
 #define LED PF6
 
 // Schedule
-#define READ_RF_DELAY 4 // Ticks. ~1s
+#define TICKS_PER_SECOND 1000 // Timer 1 ticks (1ms)
+#define REPORT_INTERVAL_MAX 600000 // Ticks. 10 minutes
+#define REPORT_TIME 0 // Report every REPORT_INTERVAL ticks
+#define REPORT_SAMPLES 1 // Report every REPORT_EVERY samples
+#define REPORT_OFF 2 // Only answer queries
+#define REPORT_QUEUE_LEN 4 // Readings held while the line is busy
+#define REPORT_LINE_MAX 120 // Longest reading line, with STATS, FLOATREF and a delay. Fits the TX queue
+
+// Text output
+#define STACK_PAINT 0xC5 // Fill for unused RAM, so DEBUG can tell how deep the stack has reached
+#define USB_TX_TIMEOUT 20 // Ticks to wait for room in the TX queue before dropping text
 
 // EEPROM Offsets
-// Calibration values
+// Version 1 calibration values, only read to migrate them
 #define EEPROM_OFFSET_RF_CAL_SLOPE 0 // 1 byte * 27 Values (100MHz blocks) - Calibrate the frequency response slope
 #define EEPROM_OFFSET_RF_CAL_INTERCEPT 27 // 1 byte * 27 Values (100MHz Blocks) - Calibrate the frequency response intercept
-//#define EEPROM_OFFSET_NEXT 54
 #define EEPROM_OFFSET_EEPROM_INIT 128
+// Version 2 calibration table, a CAL_Header_t then RF_CAL_SPANS * CAL_Point_t (112 bytes)
+#define EEPROM_OFFSET_CAL_TABLE 256
+#define EEPROM_OFFSET_CAL_POINTS (EEPROM_OFFSET_CAL_TABLE + sizeof(CAL_Header_t))
+// Temperature correction
+#define EEPROM_OFFSET_TEMP_CO 368 // int16 - Reading drift in 0.001 dB/C
+#define EEPROM_OFFSET_TEMP_REF 370 // int16 - Temperature the unit was calibrated at, 0.01 C
+//#define EEPROM_OFFSET_NEXT 372
+
+// Calibration point limits and defaults
+#define RF_CAL_SLOPE_MIN 10000 // uV/dB
+#define RF_CAL_SLOPE_MAX 30000
+#define RF_CAL_SLOPE_DEFAULT 17300
+#define RF_CAL_INTERCEPT_MIN 5000 // cdB
+#define RF_CAL_INTERCEPT_MAX 9000
+#define RF_CAL_INTERCEPT_DEFAULT 6800
+
+// Temperature correction limits and defaults. Temperatures come from the host: the on-die
+// sensor needs the internal 2.56V reference, which can't be used with AREF tied to 1.2V.
+#define TEMP_MIN -4000 // 0.01 C
+#define TEMP_MAX 12500
+#define TEMP_CO_MIN -1000 // 0.001 dB/C
+#define TEMP_CO_MAX 1000
+#define TEMP_REF_DEFAULT 2500
+#define TEMP_FILTER_SHIFT 2 // EMA of the supplied temperatures, alpha = 1/4
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Types
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Binary stream frame, sent as-is (little-endian) over the CDC interface.
+// Sequence increments for every frame, including frames that could not be sent,
+// so the host can detect drops from gaps.
+typedef struct {
+	uint16_t Sync; // STREAM_SYNC
+	uint16_t Sequence;
+	uint32_t Tick; // Scheduler timer ticks (1ms) when the first sample was taken, or its index if timed
+	uint8_t Span; // Calibration span in use
+	uint8_t Flags; // STREAM_FLAG_*
+	int16_t Samples[STREAM_FRAME_SAMPLES];
+} __attribute__((packed)) STREAM_Frame_t;
+
+// EEPROM calibration table header. The CRC16 (XMODEM) covers the points that follow.
+typedef struct {
+	uint8_t Version; // EEPROM_VERS
+	uint8_t Count; // Points, one per 100MHz span
+	uint16_t CRC;
+} __attribute__((packed)) CAL_Header_t;
+
+// One calibration point
+typedef struct {
+	uint16_t Slope; // uV/dB
+	int16_t Intercept; // cdB
+} __attribute__((packed)) CAL_Point_t;
+
+// Least squares sums of the reference levels measured in one span, x the level in cdB
+// above FIT_LEVEL_MIN (up to 8000) and y the detector voltage in FIT_VOLTAGE_STEPs (up
+// to 12000). FIT_SPAN_POINTS_MAX of them keep SumXY under 2^31.
+typedef struct {
+	uint8_t Count;
+	uint32_t SumX;
+	uint32_t SumY;
+	uint32_t SumXX;
+	uint32_t SumXY;
+} __attribute__((packed)) FIT_Span_t;
+
+// A reading waiting to be printed
+typedef struct {
+	unsigned long Tick; // When it was taken
+	uint8_t Held; // Couldn't be printed when taken
+	uint16_t Average; // Raw ADC counts, as are the statistics
+	uint16_t Min;
+	uint16_t Max;
+	uint16_t Mean;
+	uint32_t Count;
+} REPORT_Entry_t;
+
+// Command table entry. Handlers get the number of arguments given and their values.
+typedef struct {
+	PGM_P Name; // Upper case
+	uint8_t (*Handler)(uint8_t count, const long * args);
+	uint8_t Args; // Required arguments
+	uint8_t Optional; // Optional arguments after those
+	long Min[CMD_ARGS_MAX];
+	long Max[CMD_ARGS_MAX];
+	uint8_t Flags; // CMD_FLAG_*
+} CMD_Entry_t;
+
+// SCPI error number and message for an ERR_* code
+typedef struct {
+	int16_t Code;
+	PGM_P Message;
+} ERROR_Entry_t;
+
+// Binary block header, followed by Length bytes of payload and a CRC16 (XMODEM, little-endian)
+// covering the header and payload.
+typedef struct {
+	uint16_t Sync; // BLOCK_SYNC
+	uint8_t Type; // BLOCK_TYPE_*
+	uint8_t Span; // Calibration span in use
+	uint16_t Param; // Type specific, ie. the trigger position of a capture
+	uint16_t Length; // Payload bytes
+} __attribute__((packed)) BLOCK_Header_t;
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // ~~ Globals
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+// Linker and malloc symbols bounding the free RAM between the heap and the stack
+extern uint8_t _end;
+extern uint8_t __stack;
+extern char * __brkval;
 // Timer
 volatile unsigned long timer = 0;
 // Schedule
 volatile uint8_t schedule_read_rf = 0;
+uint8_t USB_TX_STALLED = 0; // The host stopped reading, drop text until the TX queue empties
+volatile uint32_t report_countdown = TICKS_PER_SECOND;
+// ADC
+volatile uint8_t ADC_DISCARD = 0;
+volatile uint8_t ADC_CONVERTED = 0; // Set by every ADC_vect, to tell what ended a sleep
+uint8_t ADC_SLEEP = 0; // Convert in ADC Noise Reduction sleep instead of on the timer
+uint16_t ADC_TIMER_HZ = ADC_TIMER_HZ_DEFAULT; // Conversions per second on the timer 0 clock, 0 for free-running
+uint32_t ADC_TIMER_CHZ = 0; // Actual conversion rate in 0.01 Hz, 0 when not timed
+const uint8_t ADC_TIMER_SHIFTS[] PROGMEM = {0, 3, 6, 8, 10}; // Timer 0 prescalers /1 - /1024
+volatile uint8_t ADC_OVERSAMPLE = 0; // Extra bits of resolution, 0 - ADC_OVERSAMPLE_MAX
+uint32_t ADC_OS_SUM = 0; // Oversampling accumulator, only touched by ADC_vect
+uint16_t ADC_OS_COUNT = 1;
+// Sample buffer. Single producer (ADC_vect), single consumer (main loop).
+// Head is only written by the interrupt, tail only by the main loop. Both run freely
+// over 0-255 and are masked on access, so neither side ever has to disable interrupts.
+uint16_t SAMPLES_BUFF[SAMPLES_BUFF_LEN];
+volatile uint8_t SAMPLES_HEAD = 0;
+volatile uint8_t SAMPLES_TAIL = 0;
+volatile uint8_t SAMPLES_OVERFLOW = 0;
+volatile uint16_t SAMPLES_GAP = 0; // Samples dropped since the last one stored, only touched by ADC_vect
+uint32_t SAMPLES_INDEX = 0; // Samples produced since acquisition started, including dropped ones
 
 // Standard file stream for the CDC interface when set up, so that the
 // virtual CDC COM port can be used like any regular character stream
@@ -74,7 +327,7 @@ volatile uint8_t schedule_read_rf = 0;
 static FILE USBSerialStream;
 
 // Help string
-const char STR_Help_Info[] PROGMEM = "\r\n\"F<Frequency in MHz>\" to load the appropriate calibration values.\r\n\"R<1-10>\" to set the interval between readings (in seconds).\r\n\r\nVisit https://github.com/EnhancedRadioDevices/RF-Power-Meter for full docs.";
+const char STR_Help_Info[] PROGMEM = "\"F<Frequency in MHz>\" to load the appropriate calibration values.\r\n\"R<0-600>\" to set the interval between readings (in seconds, 0 for none).\r\n\"INTERVAL<0-600000>\" to set the interval between readings (in milliseconds, 0 for none).\r\n\"EVERY<1-65535>\" to print a reading every N samples.\r\n\"AVG<0-65535>\" to set the number of samples averaged per reading (0 for all since the last reading).\r\n\"FILTER<0-3> [shift]\" to filter readings by block mean (0, uses AVG), EMA (1, alpha 2^-shift, 1-15), 2^shift boxcar (2, 1-6) or CIC decimating by 2^shift (3, 1-6).\r\n\"OVERSAMPLE<0-4>\" to add bits of resolution by summing 4^N conversions per sample.\r\n\"ADCSLEEP<0-1>\" to take each conversion in ADC Noise Reduction sleep (1), or at the SRATE (0).\r\n\"SRATE<4-1600>\" to set the conversion rate in Hz (default 1000), 0 for free-running. Not while ADCSLEEP is on.\r\n\"BURST<1-256> [dBm]\" to capture N raw samples now, or once the input rises through the given level. Captures run free-running, about 4.8k samples/s.\r\n\"TRIGGER<pre> <post> <dBm>\" to capture raw samples around the input rising through the given level (pre + post up to 256).\r\n\"STATS\" to toggle printing the min, max and mean of every sample since the last reading.\r\n\"HIST\", \"CCDF\", \"PAPR\" to send the power histogram as a binary block, or print its CCDF or peak to average ratio. \"HISTRESET\" clears it.\r\n\"CALGET\", \"CALPUT\" to send the calibration table as a binary block, or receive one and save it.\r\n\"CALPOINT<MHz> <cdBm>\" to measure a reference level at a span's centre frequency (50, 150, ... MHz), up to 16 per span. \"CALSTATUS\" shows the samples left and the points measured. \"CALFIT\" fits and saves every measured span, \"CALCLEAR\" discards the levels.\r\n\"TEMP<0.01 C>\" to supply the unit's temperature. \"TEMPCO<0.001 dB/C> <0.01 C>\" to save its drift, and the temperature it was calibrated at.\r\n\"MACHINE<0-1>\" for scripted hosts: no echo or prompts, and OK or ERR <code> after each command.\r\nSCPI: \"*IDN?\", \"MEAS:POW?\", \"TRIG\", \"FETC?\", \"SENS:FREQ <MHz>\", \"SENS:AVER:COUN <1-65535>\", \"SYST:ERR?\". MEAS:POW? and TRIG restart the filter, and the window of the next periodic reading.\r\n\"STREAM<0-2>\" to stop, or stream binary frames of raw (1) or dBm (2) samples.\r\n\r\nVisit https://github.com/EnhancedRadioDevices/RF-Power-Meter for full docs.";
 
 // Reused strings
 #ifdef ENABLECOLORS
@@ -85,9 +338,42 @@ const char STR_Help_Info[] PROGMEM = "\r\n\"F<Frequency in MHz>\" to load the ap
 	const char STR_Freq_Range[] PROGMEM = "\r\nFrequency out of range. Using defaults.";
 #endif	
 
+const char STR_IDN[] PROGMEM = "Enhanced Radio Devices,RF Power Meter " HARDWARE_VERS ",0," SOFTWARE_VERS;
+const char STR_Err_None[] PROGMEM = "No error";
+const char STR_Err_Unknown[] PROGMEM = "Undefined header";
+const char STR_Err_Args[] PROGMEM = "Syntax error";
+const char STR_Err_Range[] PROGMEM = "Data out of range";
+const char STR_Err_State[] PROGMEM = "Execution error";
+const char STR_Err_Length[] PROGMEM = "Input buffer overrun";
+const char STR_Err_Block[] PROGMEM = "Device-specific error";
+const char STR_Err_Overflow[] PROGMEM = "Queue overflow";
+
+// Indexed by ERR_* code
+const ERROR_Entry_t ERROR_TABLE[] PROGMEM = {
+	{0, STR_Err_None},
+	{-113, STR_Err_Unknown},
+	{-102, STR_Err_Args},
+	{-222, STR_Err_Range},
+	{-200, STR_Err_State},
+	{-363, STR_Err_Length},
+	{-300, STR_Err_Block},
+	{-350, STR_Err_Overflow}
+};
+
 const char STR_Backspace[] PROGMEM = "\x1b[D \x1b[D";
 const char STR_Load_Cal[] PROGMEM = "\r\nLoading calibration values for frequency: ";
 const char STR_Rate_Set[] PROGMEM = "\r\nPrinting rate set to ";
+const char STR_Reports_Off[] PROGMEM = "\r\nReadings off.";
+const char STR_Avg_Set[] PROGMEM = "\r\nAveraging window set to ";
+const char STR_Filter_Set[] PROGMEM = "\r\nFilter set.";
+const char STR_SRate_Set[] PROGMEM = "\r\nConversion clock set to ";
+const char STR_Oversample_Set[] PROGMEM = "\r\nResolution set to ";
+const char STR_Capture_Armed[] PROGMEM = "\r\nCapture armed.";
+const char STR_Hist_Empty[] PROGMEM = "\r\nHistogram is empty.";
+const char STR_Cal_Ready[] PROGMEM = "\r\nReady for calibration block.";
+const char STR_Cal_Saved[] PROGMEM = "\r\nCalibration saved.";
+const char STR_Cal_Failed[] PROGMEM = "\r\nCalibration upload failed.";
+const char STR_Fit_Measuring[] PROGMEM = "\r\nMeasuring reference level...";
 const char STR_Slope_Set[] PROGMEM = "\r\nSlope set.";
 const char STR_Intercept_Set[] PROGMEM = "\r\nIntercept set.";
 
@@ -95,17 +381,143 @@ const char STR_Intercept_Set[] PROGMEM = "\r\nIntercept set.";
 const char STR_Command_HELP[] PROGMEM = "HELP";
 const char STR_Command_DEBUG[] PROGMEM = "DEBUG";
 const char STR_Command_SETSLOPE[] PROGMEM = "SETSLOPE";
+const char STR_Command_SRATE[] PROGMEM = "SRATE";
 const char STR_Command_SETINTERCEPT[] PROGMEM = "SETINTERCEPT";
 const char STR_Command_OUTPUTRAW[] PROGMEM = "OUTPUTRAW";
+const char STR_Command_STREAM[] PROGMEM = "STREAM";
+const char STR_Command_STATS[] PROGMEM = "STATS";
+const char STR_Command_CALGET[] PROGMEM = "CALGET";
+const char STR_Command_CALPUT[] PROGMEM = "CALPUT";
+const char STR_Command_CALSTATUS[] PROGMEM = "CALSTATUS";
+const char STR_Command_TEMPCO[] PROGMEM = "TEMPCO";
+const char STR_Command_TEMP[] PROGMEM = "TEMP";
+const char STR_Command_CALPOINT[] PROGMEM = "CALPOINT";
+const char STR_Command_CALFIT[] PROGMEM = "CALFIT";
+const char STR_Command_CALCLEAR[] PROGMEM = "CALCLEAR";
+const char STR_Command_FILTER[] PROGMEM = "FILTER";
+const char STR_Command_HISTRESET[] PROGMEM = "HISTRESET";
+const char STR_Command_HIST[] PROGMEM = "HIST";
+const char STR_Command_CCDF[] PROGMEM = "CCDF";
+const char STR_Command_PAPR[] PROGMEM = "PAPR";
+const char STR_Command_OVERSAMPLE[] PROGMEM = "OVERSAMPLE";
+const char STR_Command_ADCSLEEP[] PROGMEM = "ADCSLEEP";
+const char STR_Command_BURST[] PROGMEM = "BURST";
+const char STR_Command_TRIGGER[] PROGMEM = "TRIGGER";
+const char STR_Command_INTERVAL[] PROGMEM = "INTERVAL";
+const char STR_Command_EVERY[] PROGMEM = "EVERY";
+const char STR_Command_AVG[] PROGMEM = "AVG";
+const char STR_Command_MACHINE[] PROGMEM = "MACHINE";
+const char STR_Command_IDN[] PROGMEM = "*IDN?";
+const char STR_Command_MEAS_POW[] PROGMEM = "MEAS:POW?";
+const char STR_Command_SENS_FREQ[] PROGMEM = "SENS:FREQ";
+const char STR_Command_SENS_AVER_COUN[] PROGMEM = "SENS:AVER:COUN";
+const char STR_Command_TRIG[] PROGMEM = "TRIG";
+const char STR_Command_FETC[] PROGMEM = "FETC?";
+const char STR_Command_SYST_ERR[] PROGMEM = "SYST:ERR?";
+const char STR_Command_F[] PROGMEM = "F";
+const char STR_Command_R[] PROGMEM = "R";
+#ifdef FLOAT_REFERENCE
+	const char STR_Command_FLOATREF[] PROGMEM = "FLOATREF";
+#endif
 
 // State Variables
 char * DATA_IN;
 uint8_t DATA_IN_POS = 0;
+uint8_t INPUT_DISCARD = 0; // Rest of an overlong line, dropped up to its CR or LF
+uint8_t MACHINE_MODE = 0; // No echo or prompts, one line OK / ERR <code> responses
+uint8_t ERROR_QUEUE[ERROR_QUEUE_LEN];
+uint8_t ERROR_QUEUE_HEAD = 0;
+uint8_t ERROR_QUEUE_COUNT = 0;
+uint8_t MEAS_STATE = MEAS_IDLE;
+uint8_t MEAS_QUERY = 0; // A query is waiting for the reading
+uint16_t MEAS_RESULT = 0;
 uint8_t BOOT_RESET_VECTOR = 0;
-float RF_FREQ_SLOPE = 0.0;
-uint8_t RF_FREQ_INTERCEPT = 0;
-uint8_t PRINTING_RATE = 1;
+CAL_Point_t CAL_POINTS[RF_CAL_SPANS]; // RAM copy of the EEPROM table, written through
+uint16_t RF_FREQ = 0; // MHz
+uint16_t FIT_COUNT = 0; // Points summed since the last CALFIT or CALCLEAR
+uint16_t FIT_LEFT = 0; // Samples still to sum for the point being measured, 0 when idle
+uint32_t FIT_SUM = 0;
+uint8_t FIT_SPAN = 0; // Span of the point being measured
+int16_t FIT_LEVEL = 0; // cdBm
+uint32_t FIT_VOLTAGE = 0; // uV, mean detector output of the last point measured
+uint8_t RF_FREQ_SPAN = 0;
+uint16_t RF_FREQ_SLOPE = 0; // uV/dB, interpolated for RF_FREQ
+int16_t RF_FREQ_INTERCEPT = 0; // cdB, interpolated for RF_FREQ
+uint16_t RF_CAL_GAIN = 0;
+int16_t RF_CAL_OFFSET = 0;
+int16_t TEMP_CO = 0; // 0.001 dB/C
+int16_t TEMP_REF = TEMP_REF_DEFAULT; // 0.01 C
+int16_t TEMP_NOW = 0; // 0.01 C, filtered
+uint8_t TEMP_VALID = 0; // No correction until a temperature has been supplied
+volatile uint8_t REPORT_MODE = REPORT_TIME;
+volatile uint32_t REPORT_INTERVAL = TICKS_PER_SECOND;
+uint16_t REPORT_EVERY = 0;
+uint16_t REPORT_SAMPLE_COUNT = 0;
+REPORT_Entry_t REPORT_QUEUE[REPORT_QUEUE_LEN];
+uint8_t REPORT_QUEUE_HEAD = 0;
+uint8_t REPORT_QUEUE_COUNT = 0;
+uint16_t REPORT_DROPPED = 0; // Readings lost because the queue was full
+uint16_t AVG_WINDOW = ADC_AVG_POINTS; // 0 averages everything since the last report
 uint8_t OUTPUTRAW = 0;
+#ifdef FLOAT_REFERENCE
+	uint8_t FLOATREF = 0;
+#endif
+uint8_t STREAM_MODE = STREAM_OFF;
+STREAM_Frame_t STREAM_FRAME;
+uint8_t STREAM_FRAME_POS = 0;
+uint16_t STREAM_DROPPED = 0; // Frames skipped because the CDC transmit queue was full
+BLOCK_Header_t BLOCK_HEADER;
+const uint8_t * BLOCK_DATA;
+uint16_t BLOCK_POS = 0;
+uint8_t BLOCK_RX_TYPE = 0; // Block type being received, 0 when not receiving
+BLOCK_Header_t BLOCK_RX_HEADER;
+uint8_t * BLOCK_RX_BUFF;
+uint16_t BLOCK_RX_MAX = 0;
+uint16_t BLOCK_RX_POS = 0;
+uint16_t BLOCK_RX_CRC = 0;
+unsigned long BLOCK_RX_LAST = 0; // Tick of the last byte received
+uint16_t BLOCK_TOTAL = 0; // Header, payload and CRC bytes
+uint16_t BLOCK_CRC = 0;
+uint16_t CAPTURE_BUFF[CAPTURE_BUFF_LEN]; // Also stages calibration uploads, and holds the fit sums
+volatile uint8_t CAPTURE_STATE = CAPTURE_IDLE;
+uint16_t CAPTURE_POS = 0; // Only touched by ADC_vect while a capture is running
+uint16_t CAPTURE_LEN = 0; // Pre and post-trigger samples, the buffer is circular over this length
+uint8_t CAPTURE_PRE = 0; // Pre-trigger samples wanted
+uint8_t CAPTURE_SEEN = 0; // Pre-trigger samples kept so far
+uint16_t CAPTURE_REMAINING = 0; // Post-trigger samples still to record
+uint16_t CAPTURE_THRESHOLD = 0; // Raw ADC counts
+// Calibration fit sums for every span, in the capture buffer from the first CALPOINT until
+// CALFIT or CALCLEAR. Captures and uploads are refused meanwhile, see FIT_Holding().
+#define FIT_SPANS ((FIT_Span_t *)CAPTURE_BUFF)
+_Static_assert(sizeof(FIT_Span_t) * RF_CAL_SPANS <= sizeof(CAPTURE_BUFF), "The fit sums must fit in the capture buffer");
+uint32_t RF_AVG_SUM = 0;
+uint16_t RF_AVG_COUNT = 0;
+uint32_t RF_AVG_LAST_SUM = 0; // Last complete window, divided out only when read
+uint16_t RF_AVG_LAST_COUNT = 0;
+uint8_t FILTER_MODE = FILTER_MEAN;
+uint8_t FILTER_SHIFT = 0;
+uint32_t FILTER_ACC = 0; // EMA state or boxcar running sum
+uint16_t FILTER_RING[FILTER_BOXCAR_LEN]; // Boxcar history
+uint8_t FILTER_POS = 0; // Boxcar ring position, or CIC decimation phase
+uint32_t FILTER_INT[FILTER_CIC_ORDER]; // CIC integrators, wrap around harmlessly
+uint32_t FILTER_COMB[FILTER_CIC_ORDER]; // CIC comb delays
+uint16_t FILTER_COUNT = 0; // Inputs (EMA, boxcar) or outputs (CIC) since the reset
+uint16_t FILTER_OUT = 0;
+uint8_t FILTER_READY = 0;
+uint8_t STATS = 0; // Print the interval statistics with each reading
+uint16_t RF_STAT_MIN = UINT16_MAX; // Every sample since the last reading
+uint16_t RF_STAT_MAX = 0;
+uint32_t RF_STAT_SUM = 0; // Fits one 600s report interval at any rate and oversampling
+uint32_t RF_STAT_COUNT = 0;
+uint16_t HIST_BINS[HIST_BINS_LEN]; // Every sample, binned by raw ADC counts
+uint8_t HIST_SHIFT = 0; // Times every bin has been halved to stop one overflowing
+
+// 10^(-k/40) in Q15, relative power in 0.25 dB steps across one decade
+const uint16_t HIST_POWER_TABLE[40] PROGMEM = \
+		{32768, 30935, 29205, 27571, 26029, 24573, 23198, 21900, 20675, 19519, \
+		 18427, 17396, 16423, 15504, 14637, 13818, 13045, 12315, 11627, 10976, \
+		 10362,  9783,  9235,  8719,  8231,  7771,  7336,  6925,  6538,  6172, \
+		  5827,  5501,  5193,  4903,  4629,  4370,  4125,  3894,  3677,  3471};
 
 // Default calibration tables
 const uint8_t RF_CAL_DEFAULTS_SLOPE[27] = \
@@ -129,12 +541,12 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface = {
 		.DataINEndpoint           = {
 			.Address          = CDC_TX_EPADDR,
 			.Size             = CDC_TXRX_EPSIZE,
-			.Banks            = 1,
+			.Banks            = 2,
 		},
 		.DataOUTEndpoint = {
 			.Address          = CDC_RX_EPADDR,
 			.Size             = CDC_TXRX_EPSIZE,
-			.Banks            = 1,
+			.Banks            = 2,
 		},
 		.NotificationEndpoint = {
 			.Address          = CDC_NOTIFICATION_EPADDR,
@@ -156,37 +568,218 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface = {
 
 // USB
 static inline void run_lufa(void);
+static inline void USB_Flush(void);
+static int USB_Putchar(char c, FILE * stream);
 
 // EEPROM Read & Write
 static inline void EEPROM_Reset(void);
 static inline void EEPROM_Init(void);
-static inline void EEPROM_Write_RF_Cal_Slope(uint8_t span, float value);
-static inline float EEPROM_Read_RF_Cal_Slope(uint8_t span);
-static inline void EEPROM_Write_RF_Cal_Intercept(uint8_t span, uint8_t value);
-static inline uint8_t EEPROM_Read_RF_Cal_Intercept(uint8_t span);
+static inline void EEPROM_Migrate_V1(void);
+static inline uint16_t EEPROM_Cal_CRC(void);
+static inline uint8_t EEPROM_Cal_Load(void);
+static inline void EEPROM_Cal_Save(void);
+static inline void EEPROM_Cal_Seal(void);
+static inline uint8_t EEPROM_Cal_Put(const BLOCK_Header_t * header, const CAL_Point_t * points);
+static inline void EEPROM_Write_RF_Cal_Slope(uint8_t span, uint16_t value);
+static inline void EEPROM_Write_RF_Cal_Intercept(uint8_t span, int16_t value);
 
 // DEBUG
 static inline void DEBUG_Dump(void);
+void DEBUG_Stack_Paint(void) __attribute__((naked, used, section(".init1")));
+static inline uint16_t DEBUG_Stack_Unused(void);
 
 // ADC
+static inline void ADC_Start_RF(void);
+static inline void ADC_Trigger_Start(void);
+static inline void ADC_Timer_Start(void);
+static inline void ADC_Timer_Stop(void);
+static inline void ADC_Sleep_Convert(void);
+static inline void ADC_Process(void);
 static inline int16_t ADC_Read_RF(void);
+static inline void ADC_Stats_Reset(void);
+static inline void ADC_Filter(uint16_t sample);
+static inline void ADC_Filter_Reset(void);
 static inline void Load_RF_Calibration(uint16_t freq);
+static inline int16_t RF_Counts_To_cdBm(uint16_t counts);
+static inline uint16_t RF_cdBm_To_Counts(int16_t cdbm);
+static inline uint16_t RF_Counts_To_mV(uint16_t counts);
+static inline void RF_Cal_Offset_Update(void);
+
+// Temperature
+static inline void TEMP_Load(void);
+static inline void TEMP_Save(void);
+static inline void TEMP_Set(int16_t temp);
+
+// Capture
+static inline void CAPTURE_Start(uint8_t pre, uint16_t post, int16_t threshold);
+static inline void CAPTURE_Sample(uint16_t sample);
+static inline void CAPTURE_Reverse(uint16_t start, uint16_t end);
+static inline void CAPTURE_Send(void);
+
+// Binary Blocks
+static inline void BLOCK_Start(uint8_t type, uint16_t param, const void * data, uint16_t length);
+static inline uint8_t BLOCK_Busy(void);
+static inline void BLOCK_Continue(void);
+static inline void BLOCK_Receive_Start(uint8_t type, void * buff, uint16_t max);
+static inline uint8_t BLOCK_Receiving(void);
+static inline void BLOCK_Receive(void);
+static inline void BLOCK_Receive_Done(uint8_t ok);
+
+// Calibration fit
+static inline uint8_t FIT_Holding(void);
+static inline void FIT_Start(uint8_t span, int16_t level);
+static inline void FIT_Restart(void);
+static inline void FIT_Sample(uint16_t sample);
+static inline int32_t FIT_Div_Round(int64_t num, int64_t den);
+static inline void FIT_Spans(void);
+
+// Histogram
+static inline void HIST_Add(uint16_t sample);
+static inline void HIST_Reset(void);
+static inline int16_t HIST_Bin_cdBm(uint16_t bin);
+static inline uint16_t HIST_Rel_Power(uint16_t below);
+static inline uint32_t HIST_PAPR(int16_t * peak, uint16_t * papr);
+static inline uint8_t HIST_Print_PAPR(void);
+static inline uint8_t HIST_Print_CCDF(void);
+
+// Sample Buffer
+static inline void SAMPLES_Insert(uint16_t sample);
+static inline uint8_t SAMPLES_Count(void);
+static inline uint8_t SAMPLES_Peek(const uint16_t ** span);
+static inline void SAMPLES_Consume(uint8_t count);
+
+// Streaming
+static inline void STREAM_Start(uint8_t mode);
+static inline void STREAM_Sample(uint16_t sample);
+static inline void STREAM_Gap(void);
 
 // LED
 static inline void Set_LED(int8_t state);
 
 // Output
 static inline void printPGMStr(PGM_P s);
+static inline void PRINT_Fixed(int32_t value, uint8_t decimals);
+static inline void PRINT_Level(uint16_t counts);
+static inline void PRINT_OK(void);
+static inline void PRINT_Error(uint8_t code);
+static inline void PRINT_Line_Start(void);
+static inline void PRINT_Line_End(void);
+static inline void ERROR_Push(uint8_t code);
+static inline uint8_t ERROR_Pop(void);
 static inline void PRINT_Status(void);
 static inline void PRINT_Help(void);
 
+// Schedule
+static inline void Set_Report_Interval(uint32_t ticks);
+
+// Measurements
+static inline void MEAS_Start(void);
+static inline void MEAS_Check(void);
+static inline void MEAS_Print(void);
+
+// Reports
+static inline uint8_t REPORT_Take(uint8_t held);
+static inline void REPORT_Print_Next(void);
+
 // Input
-static inline long INPUT_Parse_num(void);
+static inline uint8_t INPUT_Parse_num(const char ** cursor, long * value);
 static inline void INPUT_Clear(void);
 static inline void INPUT_Parse(void);
 
+// Command handlers
+static uint8_t CMD_Idn(uint8_t count, const long * args);
+static uint8_t CMD_ADCSleep(uint8_t count, const long * args);
+static uint8_t CMD_Avg(uint8_t count, const long * args);
+static uint8_t CMD_Burst(uint8_t count, const long * args);
+static uint8_t CMD_CalClear(uint8_t count, const long * args);
+static uint8_t CMD_CalFit(uint8_t count, const long * args);
+static uint8_t CMD_CalGet(uint8_t count, const long * args);
+static uint8_t CMD_CalPoint(uint8_t count, const long * args);
+static uint8_t CMD_CalPut(uint8_t count, const long * args);
+static uint8_t CMD_CalStatus(uint8_t count, const long * args);
+static uint8_t CMD_CCDF(uint8_t count, const long * args);
+static uint8_t CMD_Debug(uint8_t count, const long * args);
+static uint8_t CMD_Every(uint8_t count, const long * args);
+static uint8_t CMD_Fetch(uint8_t count, const long * args);
+static uint8_t CMD_Freq(uint8_t count, const long * args);
+static uint8_t CMD_Filter(uint8_t count, const long * args);
+#ifdef FLOAT_REFERENCE
+	static uint8_t CMD_FloatRef(uint8_t count, const long * args);
+#endif
+static uint8_t CMD_Help(uint8_t count, const long * args);
+static uint8_t CMD_Hist(uint8_t count, const long * args);
+static uint8_t CMD_HistReset(uint8_t count, const long * args);
+static uint8_t CMD_Interval(uint8_t count, const long * args);
+static uint8_t CMD_Machine(uint8_t count, const long * args);
+static uint8_t CMD_Measure(uint8_t count, const long * args);
+static uint8_t CMD_OutputRaw(uint8_t count, const long * args);
+static uint8_t CMD_Oversample(uint8_t count, const long * args);
+static uint8_t CMD_PAPR(uint8_t count, const long * args);
+static uint8_t CMD_Rate(uint8_t count, const long * args);
+static uint8_t CMD_SetIntercept(uint8_t count, const long * args);
+static uint8_t CMD_SetSlope(uint8_t count, const long * args);
+static uint8_t CMD_SRate(uint8_t count, const long * args);
+static uint8_t CMD_Stats(uint8_t count, const long * args);
+static uint8_t CMD_Stream(uint8_t count, const long * args);
+static uint8_t CMD_Temp(uint8_t count, const long * args);
+static uint8_t CMD_TempCo(uint8_t count, const long * args);
+static uint8_t CMD_SystErr(uint8_t count, const long * args);
+static uint8_t CMD_Trig(uint8_t count, const long * args);
+static uint8_t CMD_Trigger(uint8_t count, const long * args);
+
 // Watchdog
 static inline void Watchdog_Disable(void);
 static inline void Watchdog_Enable(void);
 
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ~~ Command Table
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Binary searched by INPUT_Parse(), so keep it sorted by name (ASCII order)
+const CMD_Entry_t CMD_TABLE[] PROGMEM = {
+	// Name, handler, arguments, optional arguments, argument minimums, argument maximums, flags
+	{STR_Command_IDN, CMD_Idn, 0, 0, {0}, {0}, CMD_FLAG_SCPI},
+	{STR_Command_ADCSLEEP, CMD_ADCSleep, 1, 0, {0}, {1}, 0},
+	{STR_Command_AVG, CMD_Avg, 1, 0, {0}, {ADC_AVG_MAX}, 0},
+	{STR_Command_BURST, CMD_Burst, 1, 1, {1, -100}, {CAPTURE_BUFF_LEN, 100}, 0},
+	{STR_Command_CALCLEAR, CMD_CalClear, 0, 0, {0}, {0}, 0},
+	{STR_Command_CALFIT, CMD_CalFit, 0, 0, {0}, {0}, 0},
+	{STR_Command_CALGET, CMD_CalGet, 0, 0, {0}, {0}, 0},
+	{STR_Command_CALPOINT, CMD_CalPoint, 2, 0, {1, FIT_LEVEL_MIN}, {RF_CAL_SPANS * RF_CAL_SPAN_MHZ - 1, FIT_LEVEL_MAX}, 0},
+	{STR_Command_CALPUT, CMD_CalPut, 0, 0, {0}, {0}, 0},
+	{STR_Command_CALSTATUS, CMD_CalStatus, 0, 0, {0}, {0}, 0},
+	{STR_Command_CCDF, CMD_CCDF, 0, 0, {0}, {0}, 0},
+	{STR_Command_DEBUG, CMD_Debug, 0, 0, {0}, {0}, 0},
+	{STR_Command_EVERY, CMD_Every, 1, 0, {1}, {65535}, 0},
+	{STR_Command_F, CMD_Freq, 1, 0, {1}, {RF_CAL_SPANS * RF_CAL_SPAN_MHZ - 1}, 0},
+	{STR_Command_FETC, CMD_Fetch, 0, 0, {0}, {0}, CMD_FLAG_SCPI},
+	{STR_Command_FILTER, CMD_Filter, 1, 1, {FILTER_MEAN, 0}, {FILTER_CIC, FILTER_EMA_SHIFT_MAX}, 0},
+	#ifdef FLOAT_REFERENCE
+		{STR_Command_FLOATREF, CMD_FloatRef, 0, 0, {0}, {0}, 0},
+	#endif
+	{STR_Command_HELP, CMD_Help, 0, 0, {0}, {0}, 0},
+	{STR_Command_HIST, CMD_Hist, 0, 0, {0}, {0}, 0},
+	{STR_Command_HISTRESET, CMD_HistReset, 0, 0, {0}, {0}, 0},
+	{STR_Command_INTERVAL, CMD_Interval, 1, 0, {0}, {REPORT_INTERVAL_MAX}, 0},
+	{STR_Command_MACHINE, CMD_Machine, 1, 0, {0}, {1}, 0},
+	{STR_Command_MEAS_POW, CMD_Measure, 0, 0, {0}, {0}, CMD_FLAG_SCPI},
+	{STR_Command_OUTPUTRAW, CMD_OutputRaw, 0, 0, {0}, {0}, 0},
+	{STR_Command_OVERSAMPLE, CMD_Oversample, 1, 0, {0}, {ADC_OVERSAMPLE_MAX}, 0},
+	{STR_Command_PAPR, CMD_PAPR, 0, 0, {0}, {0}, 0},
+	{STR_Command_R, CMD_Rate, 1, 0, {0}, {REPORT_INTERVAL_MAX / TICKS_PER_SECOND}, 0},
+	{STR_Command_SENS_AVER_COUN, CMD_Avg, 1, 0, {1}, {ADC_AVG_MAX}, CMD_FLAG_SCPI},
+	{STR_Command_SENS_FREQ, CMD_Freq, 1, 0, {1}, {RF_CAL_SPANS * RF_CAL_SPAN_MHZ - 1}, CMD_FLAG_SCPI},
+	{STR_Command_SETINTERCEPT, CMD_SetIntercept, 2, 0, {0, RF_CAL_INTERCEPT_MIN}, {RF_CAL_SPANS - 1, RF_CAL_INTERCEPT_MAX}, 0},
+	{STR_Command_SETSLOPE, CMD_SetSlope, 2, 0, {0, RF_CAL_SLOPE_MIN}, {RF_CAL_SPANS - 1, RF_CAL_SLOPE_MAX}, 0},
+	{STR_Command_SRATE, CMD_SRate, 1, 0, {0}, {ADC_TIMER_HZ_MAX}, 0},
+	{STR_Command_STATS, CMD_Stats, 0, 0, {0}, {0}, 0},
+	{STR_Command_STREAM, CMD_Stream, 1, 0, {STREAM_OFF}, {STREAM_CDBM}, 0},
+	{STR_Command_SYST_ERR, CMD_SystErr, 0, 0, {0}, {0}, CMD_FLAG_SCPI},
+	{STR_Command_TEMP, CMD_Temp, 1, 0, {TEMP_MIN}, {TEMP_MAX}, 0},
+	{STR_Command_TEMPCO, CMD_TempCo, 2, 0, {TEMP_CO_MIN, TEMP_MIN}, {TEMP_CO_MAX, TEMP_MAX}, 0},
+	{STR_Command_TRIG, CMD_Trig, 0, 0, {0}, {0}, CMD_FLAG_SCPI},
+	{STR_Command_TRIGGER, CMD_Trigger, 3, 0, {0, 1, -100}, {CAPTURE_BUFF_LEN - 1, CAPTURE_BUFF_LEN, 100}, 0},
+};
+#define CMD_TABLE_LEN (sizeof(CMD_TABLE) / sizeof(CMD_TABLE[0]))
+
 #endif